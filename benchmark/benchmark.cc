@@ -1,98 +1,544 @@
 #include "cppiperconfig.hh"
+#include "histogram.hh"
 #include "receiver.hh"
 #include "sender.hh"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <glog/logging.h>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <mutex>
+#include <optional>
 #include <pipemanager.hh>
-#include <ratio>
-#include <spdlog/common.h>
-#include <spdlog/spdlog.h>
+#include <sched.h>
+#include <sstream>
 #include <string>
 #include <thread>
-#include <tuple>
-
-using namespace std::string_literals;
-
-double sender_net(0);
-double receiver_net(0);
-
-void sender(const int msg_size, const int msg_count,
-            const std::filesystem::path pipepath,
-            std::condition_variable &conditional, std::mutex &lock,
-            bool &start) {
-  const std::string msg = cppiper::random_hex(msg_size);
-  cppiper::Sender server_sender("Server", pipepath);
-  std::unique_lock lk(lock);
-  conditional.wait(lk, [&]() { return start; });
-  std::chrono::high_resolution_clock::time_point start_time =
-      std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < msg_count; i++) {
-    server_sender.send(msg);
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//! Size of the send timestamp at the start of every streamed message.
+const size_t STAMP_SIZE = sizeof(int64_t);
+
+//! Benchmark configuration, swept as the cartesian product of its lists.
+struct Config {
+  std::vector<std::string> modes{"stream", "pingpong"};
+  std::vector<int> sizes{64, 1024, 16384};
+  std::vector<int> counts{100000};
+  std::vector<int> pairs{1};
+  std::vector<cppiper::WaitStrategy> waits{cppiper::WaitStrategy::PARK};
+  int batch = 256;
+  cppiper::Transport transport = cppiper::Transport::FIFO;
+  std::chrono::nanoseconds spin_budget = cppiper::SPIN_BUDGET_DEFAULT;
+  //! CPUs endpoint threads are pinned to, one each in turn (empty for none).
+  std::vector<int> cpus;
+  //! Scheduling policy of endpoint threads (-1 to inherit).
+  int policy = -1;
+  std::string format = "text";
+};
+
+//! Wait strategy names accepted by --wait.
+const char *const WAIT_NAMES[] = {"park", "spin", "busy"};
+
+const char *wait_name(cppiper::WaitStrategy wait) {
+  return WAIT_NAMES[static_cast<int>(wait)];
+}
+
+//! Outcome of one benchmark run.
+struct Result {
+  std::string mode;
+  cppiper::WaitStrategy wait = cppiper::WaitStrategy::PARK;
+  int pairs = 0;
+  int msg_size = 0;
+  int msg_count = 0;
+  int batch = 0;
+  double seconds = 0;
+  //! Messages that completed (short of the count if a stream ended early).
+  uint64_t messages = 0;
+  uint64_t writes = 0;
+  uint64_t reads = 0;
+  //! One-way latency (stream) or round trip time (pingpong) in nanoseconds.
+  Histogram latency;
+};
+
+//! Releases every benchmark thread at once after they have all connected.
+class StartGate {
+private:
+  std::mutex lock;
+  std::condition_variable conditional;
+  int ready = 0;
+  bool open = false;
+
+public:
+  //! Report a thread ready and wait for the gate to open.
+  void arrive_and_wait(void) {
+    std::unique_lock lk(lock);
+    ready++;
+    conditional.notify_all();
+    conditional.wait(lk, [&]() { return open; });
+  }
+
+  //! Wait for a number of threads to be ready, then release them.
+  /*!
+    \return The time the gate opened.
+   */
+  Clock::time_point open_when_ready(int threads) {
+    std::unique_lock lk(lock);
+    conditional.wait(lk, [&]() { return ready == threads; });
+    open = true;
+    conditional.notify_all();
+    return Clock::now();
   }
-  std::chrono::high_resolution_clock::time_point end_time =
-      std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double, std::micro> delta = (end_time - start_time);
-  sender_net += delta.count();
-  server_sender.terminate();
 };
 
-void receiver(const int msg_count, const std::filesystem::path pipepath,
-              std::condition_variable &conditional, std::mutex &lock,
-              bool &start) {
-  cppiper::Receiver server_receiver("Client", pipepath);
-  std::unique_lock lk(lock);
-  conditional.wait(lk, [&]() { return start; });
-  std::chrono::high_resolution_clock::time_point start_time =
-      std::chrono::high_resolution_clock::now();
+int64_t now_ns(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+//! Index of the next CPU an endpoint thread is pinned to.
+std::atomic<size_t> next_cpu(0);
+
+cppiper::ThreadOptions thread_options(const Config &config) {
+  cppiper::ThreadOptions options;
+  if (not config.cpus.empty())
+    options.cpus = {config.cpus[next_cpu++ % config.cpus.size()]};
+  options.policy = config.policy;
+  options.priority =
+      config.policy == SCHED_FIFO or config.policy == SCHED_RR ? 1 : 0;
+  return options;
+}
+
+cppiper::SenderOptions sender_options(const Config &config,
+                                      cppiper::WaitStrategy wait) {
+  cppiper::SenderOptions options;
+  options.transport = config.transport;
+  options.wait_strategy = wait;
+  options.spin_budget = config.spin_budget;
+  options.thread_options = thread_options(config);
+  return options;
+}
+
+cppiper::ReceiverOptions receiver_options(const Config &config,
+                                          cppiper::WaitStrategy wait) {
+  cppiper::ReceiverOptions options;
+  options.transport = config.transport;
+  options.wait_strategy = wait;
+  options.spin_budget = config.spin_budget;
+  options.thread_options = thread_options(config);
+  return options;
+}
+
+void stream_sender(const Config &config, int msg_size, int msg_count,
+                   const std::filesystem::path pipepath, StartGate &gate,
+                   Result &result) {
+  const std::string payload(cppiper::random_hex(msg_size));
+  cppiper::Sender sender("Sender", pipepath,
+                         sender_options(config, result.wait));
+  gate.arrive_and_wait();
   for (int i = 0; i < msg_count; i++) {
-    server_receiver.receive(true);
+    std::string msg(payload);
+    const int64_t stamp(now_ns());
+    std::memcpy(msg.data(), &stamp, STAMP_SIZE);
+    sender.send_async(std::move(msg));
   }
-  std::chrono::high_resolution_clock::time_point end_time =
-      std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double, std::micro> delta = (end_time - start_time);
-  receiver_net += delta.count();
-  server_receiver.wait();
-};
+  sender.flush();
+  sender.terminate();
+  result.writes = sender.get_write_count();
+}
 
-int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::cout << "usage: benchmark <msg_count> <msg_size>" << std::endl;
-    exit(1);
+void stream_receiver(const Config &config, int msg_count,
+                     const std::filesystem::path pipepath, StartGate &gate,
+                     Result &result, Clock::time_point &finish) {
+  cppiper::Receiver receiver("Receiver", pipepath,
+                             receiver_options(config, result.wait));
+  gate.arrive_and_wait();
+  const auto record = [&](const cppiper::Message &msg) {
+    int64_t stamp;
+    std::memcpy(&stamp, msg.data(), STAMP_SIZE);
+    result.latency.record(std::max<int64_t>(now_ns() - stamp, 0));
+  };
+  // Counts what arrived, so a stream that ends early reports a short count
+  // rather than waiting for messages that never come.
+  int received(0);
+  if (config.batch > 1) {
+    std::vector<cppiper::Message> batch;
+    batch.reserve(config.batch);
+    while (received < msg_count) {
+      batch.clear();
+      if (receiver.receive_many(batch, config.batch,
+                                std::chrono::nanoseconds::max()) == 0)
+        break;
+      for (const cppiper::Message &msg : batch)
+        record(msg);
+      received += batch.size();
+    }
+  } else {
+    for (; received < msg_count; received++) {
+      const std::optional<cppiper::Message> msg(receiver.receive(true));
+      if (not msg)
+        break;
+      record(*msg);
+    }
+  }
+  finish = Clock::now();
+  receiver.wait();
+  result.messages = received;
+  result.reads = receiver.get_read_count();
+}
+
+void pingpong_client(const Config &config, int msg_size, int msg_count,
+                     const std::filesystem::path request_path,
+                     const std::filesystem::path reply_path, StartGate &gate,
+                     Result &result, Clock::time_point &finish) {
+  const std::string payload(cppiper::random_hex(msg_size));
+  cppiper::Sender sender("Client", request_path,
+                         sender_options(config, result.wait));
+  cppiper::Receiver receiver("Client", reply_path,
+                             receiver_options(config, result.wait));
+  gate.arrive_and_wait();
+  int received(0);
+  for (; received < msg_count; received++) {
+    const int64_t start(now_ns());
+    if (not sender.send(payload) or not receiver.receive(true))
+      break;
+    result.latency.record(now_ns() - start);
   }
-  const int msg_count(atoi(argv[1]));
-  const int msg_size(atoi(argv[2]));
-  std::cout << "cppiper v" << CPPIPER_VERSION_MAJOR << '.'
-            << CPPIPER_VERSION_MINOR << " benchmark" << std::endl
-            << "Message Count: " << msg_count << std::endl
-            << "Message Size:  " << msg_size << "B" << std::endl;
+  finish = Clock::now();
+  sender.terminate();
+  receiver.wait();
+  result.messages = received;
+  result.writes = sender.get_write_count();
+  result.reads = receiver.get_read_count();
+}
+
+void pingpong_server(const Config &config, cppiper::WaitStrategy wait,
+                     int msg_count, const std::filesystem::path request_path,
+                     const std::filesystem::path reply_path, StartGate &gate) {
+  cppiper::Receiver receiver("Server", request_path,
+                             receiver_options(config, wait));
+  cppiper::Sender sender("Server", reply_path, sender_options(config, wait));
+  gate.arrive_and_wait();
+  for (int i = 0; i < msg_count; i++) {
+    const std::optional<cppiper::Message> request(receiver.receive(true));
+    if (not request)
+      break;
+    sender.send(request->view());
+  }
+  sender.terminate();
+  receiver.wait();
+}
+
+Result run(cppiper::PipeManager &pm, const Config &config,
+           const std::string &mode, cppiper::WaitStrategy wait, int pairs,
+           int msg_size, int msg_count) {
+  const bool stream(mode == "stream");
+  if (stream)
+    msg_size = std::max<int>(msg_size, STAMP_SIZE);
+  std::cerr << "running " << mode << " (" << wait_name(wait) << ", " << pairs
+            << " pairs, " << msg_count << " x " << msg_size << "B)..."
+            << std::endl;
+  std::vector<Result> results(pairs);
+  for (Result &result : results)
+    result.wait = wait;
+  std::vector<Clock::time_point> finishes(pairs);
+  std::vector<std::filesystem::path> pipes;
+  std::vector<std::thread> threads;
+  StartGate gate;
+  for (int i = 0; i < pairs; i++) {
+    const std::filesystem::path request_path(pm.lease());
+    pipes.push_back(request_path);
+    if (stream) {
+      threads.emplace_back(stream_sender, std::cref(config), msg_size,
+                           msg_count, request_path, std::ref(gate),
+                           std::ref(results[i]));
+      threads.emplace_back(stream_receiver, std::cref(config), msg_count,
+                           request_path, std::ref(gate), std::ref(results[i]),
+                           std::ref(finishes[i]));
+    } else {
+      const std::filesystem::path reply_path(pm.lease());
+      pipes.push_back(reply_path);
+      threads.emplace_back(pingpong_client, std::cref(config), msg_size,
+                           msg_count, request_path, reply_path,
+                           std::ref(gate), std::ref(results[i]),
+                           std::ref(finishes[i]));
+      threads.emplace_back(pingpong_server, std::cref(config), wait,
+                           msg_count, request_path, reply_path,
+                           std::ref(gate));
+    }
+  }
+  const Clock::time_point start(gate.open_when_ready(2 * pairs));
+  for (std::thread &thread : threads)
+    thread.join();
+  for (const std::filesystem::path &pipe : pipes)
+    pm.recycle(pipe);
+
+  Result total;
+  total.mode = mode;
+  total.wait = wait;
+  total.pairs = pairs;
+  total.msg_size = msg_size;
+  total.msg_count = msg_count;
+  total.batch = stream ? config.batch : 1;
+  const Clock::time_point finish(
+      *std::max_element(finishes.begin(), finishes.end()));
+  total.seconds = std::chrono::duration<double>(finish - start).count();
+  for (const Result &result : results) {
+    total.messages += result.messages;
+    total.writes += result.writes;
+    total.reads += result.reads;
+    total.latency.merge(result.latency);
+  }
+  if (total.messages < static_cast<uint64_t>(pairs) * msg_count)
+    std::cerr << "warning: only " << total.messages << " of "
+              << static_cast<uint64_t>(pairs) * msg_count
+              << " messages completed, the stream ended early" << std::endl;
+  return total;
+}
+
+double msgs_per_second(const Result &result) {
+  return result.seconds > 0 ? result.messages / result.seconds : 0;
+}
+
+double mb_per_second(const Result &result) {
+  return msgs_per_second(result) * result.msg_size / 1e6;
+}
+
+double micros(uint64_t nanoseconds) { return nanoseconds / 1e3; }
+
+const char *const FIELDS[] = {"mode",           "transport",     "wait",
+                              "pairs",          "msg_size",      "msg_count",
+                              "messages",       "batch",         "seconds",
+                              "msgs_per_sec",   "mb_per_sec",    "mean_us",
+                              "p50_us",         "p99_us",        "p999_us",
+                              "max_us",         "writes_per_msg",
+                              "msgs_per_read"};
+
+//! Number of leading FIELDS holding strings.
+const size_t STRING_FIELDS = 3;
+
+std::vector<std::string> values(const Config &config, const Result &result) {
+  const auto format = [](double value, int precision = 3) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(precision) << value;
+    return ss.str();
+  };
+  const Histogram &latency(result.latency);
+  return {result.mode,
+          config.transport == cppiper::Transport::FIFO ? "fifo" : "shm",
+          wait_name(result.wait),
+          std::to_string(result.pairs),
+          std::to_string(result.msg_size),
+          std::to_string(result.msg_count),
+          std::to_string(result.messages),
+          std::to_string(result.batch),
+          format(result.seconds, 6),
+          format(msgs_per_second(result)),
+          format(mb_per_second(result)),
+          format(latency.mean() / 1e3),
+          format(micros(latency.percentile(0.5))),
+          format(micros(latency.percentile(0.99))),
+          format(micros(latency.percentile(0.999))),
+          format(micros(latency.max())),
+          format(result.messages
+                     ? static_cast<double>(result.writes) / result.messages
+                     : 0),
+          format(result.reads
+                     ? static_cast<double>(result.messages) / result.reads
+                     : 0)};
+}
+
+void report(const Config &config, const std::vector<Result> &results) {
+  if (config.format == "csv") {
+    for (size_t i = 0; i < std::size(FIELDS); i++)
+      std::cout << (i ? "," : "") << FIELDS[i];
+    std::cout << std::endl;
+    for (const Result &result : results) {
+      const std::vector<std::string> row(values(config, result));
+      for (size_t i = 0; i < row.size(); i++)
+        std::cout << (i ? "," : "") << row[i];
+      std::cout << std::endl;
+    }
+  } else if (config.format == "json") {
+    std::cout << "[" << std::endl;
+    for (size_t r = 0; r < results.size(); r++) {
+      const std::vector<std::string> row(values(config, results[r]));
+      std::cout << "  {";
+      for (size_t i = 0; i < row.size(); i++) {
+        std::cout << (i ? ", " : "") << '"' << FIELDS[i] << "\": ";
+        if (i < STRING_FIELDS)
+          std::cout << '"' << row[i] << '"';
+        else
+          std::cout << row[i];
+      }
+      std::cout << "}" << (r + 1 < results.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+  } else {
+    std::cout << std::left << std::setw(9) << "mode" << std::setw(6)
+              << "wait" << std::right << std::setw(6) << "pairs"
+              << std::setw(9) << "size"
+              << std::setw(9) << "count" << std::setw(14) << "msgs/s"
+              << std::setw(10) << "MB/s" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p99 us" << std::setw(10) << "p999 us"
+              << std::setw(10) << "max us" << std::endl;
+    for (const Result &result : results) {
+      const Histogram &latency(result.latency);
+      std::cout << std::left << std::setw(9) << result.mode << std::setw(6)
+                << wait_name(result.wait) << std::right << std::setw(6)
+                << result.pairs << std::setw(9)
+                << result.msg_size << std::setw(9) << result.msg_count
+                << std::fixed << std::setprecision(0) << std::setw(14)
+                << msgs_per_second(result) << std::setprecision(1)
+                << std::setw(10) << mb_per_second(result) << std::setw(10)
+                << micros(latency.percentile(0.5)) << std::setw(10)
+                << micros(latency.percentile(0.99)) << std::setw(10)
+                << micros(latency.percentile(0.999)) << std::setw(10)
+                << micros(latency.max()) << std::endl;
+    }
+    std::cout << "(stream latencies are one-way, pingpong latencies are "
+                 "round trips)"
+              << std::endl;
+  }
+}
+
+std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream ss(list);
+  for (std::string item; std::getline(ss, item, ',');)
+    if (not item.empty())
+      items.push_back(item);
+  return items;
+}
+
+std::vector<int> split_ints(const std::string &list) {
+  std::vector<int> items;
+  for (const std::string &item : split(list))
+    items.push_back(std::max(atoi(item.c_str()), 1));
+  return items;
+}
+
+[[noreturn]] void usage(void) {
+  std::cout
+      << "usage: benchmark [<msg_count> <msg_size> [batch_size]] [options]\n"
+         "  --mode LIST       stream,pingpong (default both)\n"
+         "  --sizes LIST      message sizes in bytes (default 64,1024,16384)\n"
+         "  --counts LIST     messages per pair (default 100000)\n"
+         "  --pairs LIST      concurrent pipe pairs (default 1)\n"
+         "  --batch N         receive_many batch size, 1 to receive singly "
+         "(default 256)\n"
+         "  --transport T     fifo or shm (default fifo)\n"
+         "  --wait LIST       park,spin,busy endpoint wait strategies "
+         "(default park)\n"
+         "  --spin-us N       spin budget of the spin strategy (default 50)\n"
+         "  --cpus LIST       CPUs endpoint threads are pinned to in turn\n"
+         "  --sched P         other, fifo or rr endpoint thread scheduling\n"
+         "  --format F        text, json or csv (default text)"
+      << std::endl;
+  exit(1);
+}
+
+Config parse(int argc, char *argv[]) {
+  Config config;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg.rfind("--", 0) != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage();
+    const std::string value(argv[++i]);
+    if (arg == "--mode")
+      config.modes = split(value);
+    else if (arg == "--sizes")
+      config.sizes = split_ints(value);
+    else if (arg == "--counts")
+      config.counts = split_ints(value);
+    else if (arg == "--pairs")
+      config.pairs = split_ints(value);
+    else if (arg == "--batch")
+      config.batch = std::max(atoi(value.c_str()), 1);
+    else if (arg == "--wait") {
+      config.waits.clear();
+      for (const std::string &name : split(value)) {
+        const auto found(std::find(std::begin(WAIT_NAMES),
+                                   std::end(WAIT_NAMES), name));
+        if (found == std::end(WAIT_NAMES))
+          usage();
+        config.waits.push_back(static_cast<cppiper::WaitStrategy>(
+            found - std::begin(WAIT_NAMES)));
+      }
+    } else if (arg == "--spin-us")
+      config.spin_budget = std::chrono::microseconds(atoi(value.c_str()));
+    else if (arg == "--cpus") {
+      config.cpus.clear();
+      for (const std::string &cpu : split(value))
+        config.cpus.push_back(atoi(cpu.c_str()));
+    } else if (arg == "--sched" and
+               (value == "other" or value == "fifo" or value == "rr"))
+      config.policy = value == "other"  ? SCHED_OTHER
+                      : value == "fifo" ? SCHED_FIFO
+                                        : SCHED_RR;
+    else if (arg == "--transport" and (value == "fifo" or value == "shm"))
+      config.transport = value == "fifo" ? cppiper::Transport::FIFO
+                                         : cppiper::Transport::SHARED_MEMORY;
+    else if (arg == "--format" and
+             (value == "text" or value == "json" or value == "csv"))
+      config.format = value;
+    else
+      usage();
+  }
+  if (positional.size() == 1 or positional.size() > 3)
+    usage();
+  if (positional.size() >= 2) {
+    config.counts = split_ints(positional[0]);
+    config.sizes = split_ints(positional[1]);
+  }
+  if (positional.size() == 3)
+    config.batch = std::max(atoi(positional[2].c_str()), 1);
+  for (const std::string &mode : config.modes)
+    if (mode != "stream" and mode != "pingpong")
+      usage();
+  if (config.modes.empty() or config.waits.empty() or config.sizes.empty() or
+      config.counts.empty() or config.pairs.empty())
+    usage();
+  return config;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const Config config(parse(argc, argv));
+  if (config.format == "text")
+    std::cout << "cppiper v" << CPPIPER_VERSION_MAJOR << '.'
+              << CPPIPER_VERSION_MINOR << " benchmark" << std::endl;
 
   fLS::FLAGS_log_dir = "./";
   google::InitGoogleLogging(argv[0]);
   cppiper::PipeManager pm("pipemanager");
-  std::filesystem::path pipepath = pm.make_pipe();
-  bool start(false);
-  std::condition_variable conditional;
-  std::mutex sender_lock{};
-  std::mutex receiver_lock{};
-  std::thread sender_thread(sender, msg_size, msg_count, pipepath,
-                            std::ref(conditional), std::ref(sender_lock),
-                            std::ref(start));
-  std::thread receiver_thread(receiver, msg_count, pipepath,
-                              std::ref(conditional),
-                              std::ref(receiver_lock), std::ref(start));
-  sleep(1);
-  start = true;
-  conditional.notify_all();
-  std::cout << "running..." << std::endl;
-  sender_thread.join();
-  receiver_thread.join();
-  std::cout << "finished" << std::endl;
-  std::cout << "Result: " << (sender_net + receiver_net) / msg_count << "us/msg"
-            << std::endl;
-  pm.remove_pipe(pipepath.filename());
+  pm.collect();
+  pm.reserve(2 * static_cast<size_t>(*std::max_element(config.pairs.begin(),
+                                                       config.pairs.end())));
+  std::vector<Result> results;
+  for (const std::string &mode : config.modes)
+    for (const cppiper::WaitStrategy wait : config.waits)
+      for (const int pairs : config.pairs)
+        for (const int msg_size : config.sizes)
+          for (const int msg_count : config.counts)
+            results.push_back(
+                run(pm, config, mode, wait, pairs, msg_size, msg_count));
+  report(config, results);
   return 0;
 }
@@ -0,0 +1,105 @@
+#ifndef HISTOGRAM_HH_
+#define HISTOGRAM_HH_
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//! A log-linear latency histogram in the style of HdrHistogram.
+/*!
+  Values below 2^SUB_BUCKET_BITS are counted exactly. Larger values fall into
+  2^(SUB_BUCKET_BITS - 1) linear sub-buckets per power of two, so every
+  recorded value is reported within 1/2^(SUB_BUCKET_BITS - 1) of its true
+  value and the histogram has a fixed size however large values get.
+ */
+class Histogram {
+private:
+  //! Number of bits of precision kept for every value.
+  static const int SUB_BUCKET_BITS = 8;
+  //! Number of sub-buckets per power of two above the exact range.
+  static const uint64_t HALF_COUNT = uint64_t(1) << (SUB_BUCKET_BITS - 1);
+
+  //! Count of each bucket.
+  std::vector<uint64_t> counts;
+  //! Number of values recorded.
+  uint64_t total;
+  //! Sum of the values recorded.
+  long double sum;
+  //! Smallest value recorded.
+  uint64_t minimum;
+  //! Largest value recorded.
+  uint64_t maximum;
+
+  //! Get the bucket counting a value.
+  static size_t index(uint64_t value) {
+    if (value < 2 * HALF_COUNT)
+      return value;
+    const int shift(63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1));
+    return shift * HALF_COUNT + (value >> shift);
+  }
+
+  //! Get the largest value counted by a bucket.
+  static uint64_t highest(size_t bucket) {
+    if (bucket < 2 * HALF_COUNT)
+      return bucket;
+    const int shift(bucket / HALF_COUNT - 1);
+    const uint64_t sub_bucket(bucket - shift * HALF_COUNT);
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+public:
+  //! Construct an empty histogram.
+  Histogram(void)
+      : counts(index(std::numeric_limits<uint64_t>::max()) + 1), total(0),
+        sum(0), minimum(std::numeric_limits<uint64_t>::max()), maximum(0) {}
+
+  //! Record a value.
+  void record(uint64_t value) {
+    counts[index(value)]++;
+    total++;
+    sum += value;
+    minimum = std::min(minimum, value);
+    maximum = std::max(maximum, value);
+  }
+
+  //! Add the values recorded by another histogram.
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < counts.size(); i++)
+      counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    minimum = std::min(minimum, other.minimum);
+    maximum = std::max(maximum, other.maximum);
+  }
+
+  //! Get the number of values recorded.
+  uint64_t count(void) const { return total; }
+
+  //! Get the mean of the values recorded (0 if empty).
+  double mean(void) const { return total ? sum / total : 0; }
+
+  //! Get the largest value recorded (0 if empty).
+  uint64_t max(void) const { return maximum; }
+
+  //! Get the value below which a fraction of the recorded values fall.
+  /*!
+    \param quantile a fraction in [0, 1].
+    \return The highest value equivalent to the quantile (0 if empty).
+   */
+  uint64_t percentile(double quantile) const {
+    if (total == 0)
+      return 0;
+    const uint64_t rank(std::max<uint64_t>(
+        1, static_cast<uint64_t>(quantile * total + 0.5)));
+    uint64_t seen(0);
+    for (size_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::clamp(highest(i), minimum, maximum);
+    }
+    return maximum;
+  }
+};
+
+#endif // HISTOGRAM_HH_
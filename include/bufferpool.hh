@@ -0,0 +1,74 @@
+#ifndef BUFFERPOOL_HH_
+#define BUFFERPOOL_HH_
+#include "message.hh"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cppiper {
+
+//! Smallest pooled buffer size is 2^BUFFER_MIN_SHIFT bytes.
+const size_t BUFFER_MIN_SHIFT = 6;
+
+//! Largest pooled buffer size is 2^BUFFER_MAX_SHIFT bytes.
+const size_t BUFFER_MAX_SHIFT = 26;
+
+//! A pool of reusable message buffers.
+/*!
+  Buffers are grouped into power of two size classes. Buffers larger than the
+  largest size class are allocated on demand and freed on release. Pools are
+  shared between their owner and every outstanding cppiper::Message, so
+  messages may safely outlive the receiver that produced them.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+private:
+  //! Number of size classes.
+  static const size_t CLASS_COUNT = BUFFER_MAX_SHIFT - BUFFER_MIN_SHIFT + 1;
+
+  //! Maximum number of bytes cached per size class.
+  const size_t class_limit;
+  //! Lock guarding the free lists.
+  std::mutex lock;
+  //! Free buffers of each size class.
+  std::array<std::vector<std::unique_ptr<char[]>>, CLASS_COUNT> free_lists;
+
+  //! Get the size class able to hold a buffer.
+  /*!
+    \param size a buffer size.
+    \return Size class index (cppiper::BufferPool::CLASS_COUNT if unpooled).
+   */
+  static size_t size_class(size_t size);
+
+public:
+  //! Construct a buffer pool.
+  /*!
+    \param class_limit maximum number of bytes cached per size class.
+   */
+  explicit BufferPool(size_t class_limit = 1 << 22);
+
+  //! Acquire a message buffer.
+  /*!
+    \param size payload size.
+    \return A message of the given size with uninitialised contents.
+   */
+  Message acquire(size_t size);
+
+  //! Return a buffer to the pool.
+  /*!
+    \param buffer a buffer previously acquired from this pool.
+    \param capacity the buffer capacity.
+   */
+  void release(std::unique_ptr<char[]> buffer, size_t capacity);
+
+  //! Get the number of bytes held in free buffers.
+  /*!
+    \return Cached bytes.
+   */
+  size_t cached_bytes(void);
+};
+
+} // namespace cppiper
+
+#endif // BUFFERPOOL_HH_
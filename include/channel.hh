@@ -0,0 +1,256 @@
+#ifndef CHANNEL_HH_
+#define CHANNEL_HH_
+#include "message.hh"
+#include "receiver.hh"
+#include "sender.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace cppiper {
+
+//! Role of a channel end.
+enum class ChannelRole {
+  //! Sends requests on the request pipe and receives replies.
+  CLIENT,
+  //! Receives requests on the request pipe and sends replies.
+  SERVER,
+};
+
+//! Options for constructing a channel.
+struct ChannelOptions {
+  //! Options of the sender writing requests (client) or replies (server).
+  /*!
+    Must use the binary wire format, which carries correlation identifiers.
+   */
+  SenderOptions sender;
+  //! Options of the receiver reading replies (client) or requests (server).
+  ReceiverOptions receiver;
+  //! Timeout of calls made without one (0 to wait for replies indefinitely).
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(0);
+};
+
+//! A callable invoked with each request, returning the reply.
+/*!
+  The request is borrowed, as with cppiper::MessageHandler. A handler that
+  throws is answered with an empty reply, so its call does not wait for the
+  timeout.
+ */
+using RequestHandler = std::function<std::string(const Message &request)>;
+
+//! A duplex request/response channel over a pair of pipes.
+/*!
+  Every request carries a correlation identifier (cppiper::FLAG_CORRELATED)
+  that the server echoes on its reply, so a client can have any number of
+  requests in flight and replies may arrive in any order. Each call returns a
+  future completed when its reply is decoded, when it times out or when the
+  channel closes.
+
+  Opening a pipe blocks until its peer opens the other end, so the client
+  opens the request pipe first and the server the reply pipe last: both
+  constructors return once the other end has been constructed.
+ */
+class Channel {
+private:
+  //! A call waiting for its reply.
+  struct Call {
+    //! Completed with the reply, or empty on failure.
+    std::promise<std::optional<Message>> promise;
+    //! Time the call expires (time_point::max() for no timeout).
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  //! Identifying name of this channel instance (for debugging).
+  const std::string name;
+  //! Role of this channel end.
+  const ChannelRole role;
+  //! Construction options.
+  const ChannelOptions options;
+  //! Handler invoked for each request (servers constructed with one only).
+  const RequestHandler handler;
+  //! Sender of requests (client) or replies (server).
+  std::unique_ptr<Sender> sender;
+  //! Receiver of replies (client) or requests (server).
+  std::unique_ptr<Receiver> receiver;
+  //! Correlation identifier of the next call.
+  std::atomic<uint64_t> next_id;
+  //! Flag used to signal both pipes are open.
+  std::atomic<bool> opened;
+  //! Lock guarding the calls.
+  std::mutex lock;
+  //! Conditional used to wake handlers waiting for the pipes to open.
+  std::condition_variable open_conditional;
+  //! Conditional used to wake the timer thread.
+  std::condition_variable timer_conditional;
+  //! Calls waiting for their reply, by correlation identifier.
+  std::unordered_map<uint64_t, Call> calls;
+  //! Deadlines of the calls with a timeout.
+  std::set<std::pair<std::chrono::steady_clock::time_point, uint64_t>>
+      deadlines;
+  //! Flag used to signal the channel is closed.
+  bool closed;
+  //! Number of calls that timed out.
+  uint64_t timeouts;
+  //! Thread matching replies to calls (client only).
+  std::thread reply_thread;
+  //! Thread expiring calls past their deadline (client only).
+  std::thread timer_thread;
+
+  //! Open the request and reply pipes in the order of the role.
+  /*!
+    \param request_pipe path to the request pipe.
+    \param reply_pipe path to the reply pipe.
+   */
+  void open(const std::filesystem::path &request_pipe,
+            const std::filesystem::path &reply_pipe);
+
+  //! Reply to a request with the handler's reply.
+  /*!
+    \param request a request.
+   */
+  void serve(const Message &request);
+
+  //! Complete a call and forget it (lock must be held).
+  /*!
+    \param id correlation identifier of the call.
+    \param reply the reply, or empty on failure.
+    \return Whether or not the call was waiting.
+   */
+  bool complete(uint64_t id, std::optional<Message> reply);
+
+  //! Reply thread run method.
+  void collect_replies(void);
+
+  //! Timer thread run method.
+  void expire_calls(void);
+
+  //! Complete every waiting call with an empty reply.
+  void fail_calls(void);
+
+public:
+  //! Deleted.
+  Channel(void) = delete;
+
+  //! Construct a channel end.
+  /*!
+    \param name identifying name of this channel instance (for debugging).
+    \param request_pipe path to the pipe carrying requests.
+    \param reply_pipe path to the pipe carrying replies.
+    \param role role of this end.
+    \param options channel options.
+   */
+  Channel(const std::string name, const std::filesystem::path request_pipe,
+          const std::filesystem::path reply_pipe, ChannelRole role,
+          const ChannelOptions &options = ChannelOptions());
+
+  //! Construct a server end that replies to each request with a handler.
+  /*!
+    The handler runs on the receiver thread, or on
+    cppiper::ReceiverOptions::dispatch_threads worker threads if set, so
+    requests are served concurrently with replies still being written.
+    \param name identifying name of this channel instance (for debugging).
+    \param request_pipe path to the pipe carrying requests.
+    \param reply_pipe path to the pipe carrying replies.
+    \param handler a handler returning the reply to each request.
+    \param options channel options.
+   */
+  Channel(const std::string name, const std::filesystem::path request_pipe,
+          const std::filesystem::path reply_pipe, RequestHandler handler,
+          const ChannelOptions &options = ChannelOptions());
+
+  //! Close the channel if it is still open.
+  ~Channel(void);
+
+  //! Deleted.
+  Channel(const Channel &) = delete;
+
+  //! Deleted.
+  Channel &operator=(const Channel &) = delete;
+
+  //! Get the role of this channel end.
+  /*!
+    \return The role.
+   */
+  ChannelRole get_role(void) const;
+
+  //! Get the status code of the channel.
+  /*!
+    \return The status code of the sender if it failed, otherwise that of the
+    receiver.
+   */
+  int get_status_code(void) const;
+
+  //! Send a request without waiting for its reply (client only).
+  /*!
+    Uses the channel's default timeout.
+    \param request a request to send.
+    \return A future resolving to the reply, or to an empty optional if the
+    request could not be sent, timed out or the channel closed first.
+   */
+  std::future<std::optional<Message>> call(std::string request);
+
+  //! Send a request without waiting for its reply (client only).
+  /*!
+    \param request a request to send.
+    \param timeout time to wait for the reply (0 to wait indefinitely).
+    \return A future resolving to the reply, or to an empty optional if the
+    request could not be sent, timed out or the channel closed first.
+   */
+  std::future<std::optional<Message>> call(std::string request,
+                                           std::chrono::milliseconds timeout);
+
+  //! Get the number of calls waiting for their reply.
+  /*!
+    \return Outstanding call count.
+   */
+  size_t outstanding(void);
+
+  //! Get the number of calls that timed out.
+  /*!
+    \return Timeout count.
+   */
+  uint64_t get_timeout_count(void);
+
+  //! Receive a request (server only).
+  /*!
+    \param wait block until a request is available.
+    \return An optional that contains a request if one was available (never
+    one if the channel was constructed with a handler).
+   */
+  std::optional<Message> receive(bool wait);
+
+  //! Send the reply to a request without waiting for it to be written
+  //! (server only).
+  /*!
+    Replies may be sent in any order.
+    \param request the request replied to.
+    \param response the reply.
+    \return A future resolving to whether or not the reply was written.
+   */
+  std::future<bool> reply(const Message &request, std::string response);
+
+  //! Close the channel.
+  /*!
+    A client stops sending requests and waits for the server to close its
+    end, failing the calls still waiting. A server waits for the client to
+    close its end, then stops sending replies once every request is handled.
+    \return Whether or not the channel closed cleanly.
+   */
+  bool close(void);
+};
+
+} // namespace cppiper
+
+#endif // CHANNEL_HH_
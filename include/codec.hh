@@ -0,0 +1,75 @@
+#ifndef CODEC_HH_
+#define CODEC_HH_
+#include <cstddef>
+#include <cstdint>
+
+namespace cppiper {
+
+//! Largest input the block codec compresses.
+const size_t COMPRESS_MAX_INPUT = 0x7E000000;
+
+//! Largest ratio between decompressed and compressed block sizes.
+const size_t COMPRESS_MAX_RATIO = 255;
+
+//! Compression counters of an endpoint.
+struct CompressionStats {
+  //! Number of frames compressed or decompressed.
+  uint64_t frames = 0;
+  //! Uncompressed payload bytes.
+  uint64_t raw_bytes = 0;
+  //! Compressed payload bytes.
+  uint64_t compressed_bytes = 0;
+  //! Time spent compressing or decompressing.
+  uint64_t nanoseconds = 0;
+
+  //! Get the compression ratio.
+  /*!
+    \return Uncompressed bytes per compressed byte (0 if nothing was
+    compressed).
+   */
+  double ratio(void) const {
+    return compressed_bytes ? static_cast<double>(raw_bytes) / compressed_bytes
+                            : 0;
+  }
+
+  //! Get the CPU time spent per frame.
+  /*!
+    \return Nanoseconds per frame (0 if nothing was compressed).
+   */
+  double nanoseconds_per_frame(void) const {
+    return frames ? static_cast<double>(nanoseconds) / frames : 0;
+  }
+};
+
+//! Get the largest compressed size of a block.
+/*!
+  \param len uncompressed block size.
+  \return Buffer size compress_block() may need.
+ */
+size_t compress_bound(size_t len);
+
+//! Compress a block in the LZ4 block format.
+/*!
+  \param src uncompressed bytes.
+  \param len number of uncompressed bytes (at most
+  cppiper::COMPRESS_MAX_INPUT).
+  \param dst output buffer.
+  \param capacity output buffer size.
+  \return Compressed size, or 0 if the block did not fit in the output buffer.
+ */
+size_t compress_block(const char *src, size_t len, char *dst, size_t capacity);
+
+//! Decompress a block in the LZ4 block format.
+/*!
+  \param src compressed bytes.
+  \param len number of compressed bytes.
+  \param dst output buffer.
+  \param raw_len exact decompressed size.
+  \return Whether or not the block was valid and decompressed to exactly
+  raw_len bytes.
+ */
+bool decompress_block(const char *src, size_t len, char *dst, size_t raw_len);
+
+} // namespace cppiper
+
+#endif // CODEC_HH_
@@ -0,0 +1,170 @@
+#ifndef COROUTINE_HH_
+#define COROUTINE_HH_
+#include "message.hh"
+#include "receiver.hh"
+#include "sender.hh"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <optional>
+#include <string>
+
+namespace cppiper {
+
+//! An awaitable receiving a message (see cppiper::async_receive()).
+class ReceiveOperation {
+private:
+  //! Receiver the message is received from.
+  Receiver &receiver;
+  //! Time to give up at.
+  const std::chrono::steady_clock::time_point deadline;
+  //! Received message.
+  std::optional<Message> result;
+  //! Suspended coroutine.
+  std::coroutine_handle<> handle;
+  //! Flag set by both the completion and the suspension, so whichever comes
+  //! second resumes the coroutine.
+  std::atomic<bool> completed;
+
+public:
+  //! Deleted.
+  ReceiveOperation(const ReceiveOperation &) = delete;
+
+  //! Deleted.
+  ReceiveOperation &operator=(const ReceiveOperation &) = delete;
+
+  //! Construct an operation.
+  /*!
+    \param receiver a receiver driven by a cppiper::Reactor.
+    \param deadline time to give up at.
+   */
+  ReceiveOperation(Receiver &receiver,
+                   std::chrono::steady_clock::time_point deadline);
+
+  //! Never ready before suspending.
+  /*!
+    \return false.
+   */
+  bool await_ready(void) const noexcept;
+
+  //! Start receiving.
+  /*!
+    \param handle the awaiting coroutine.
+    \return Whether or not the coroutine stays suspended (false if a message
+    was already queued).
+   */
+  bool await_suspend(std::coroutine_handle<> handle);
+
+  //! Get the result.
+  /*!
+    \return The message, or an empty optional if the deadline passed or the
+    stream ended first.
+   */
+  std::optional<Message> await_resume(void);
+};
+
+//! An awaitable sending a message (see cppiper::async_send()).
+class SendOperation {
+private:
+  //! Sender the message is sent on.
+  Sender &sender;
+  //! Message to send.
+  std::string msg;
+  //! Time to give up at.
+  const std::chrono::steady_clock::time_point deadline;
+  //! Whether or not the message was written.
+  bool result;
+  //! Suspended coroutine.
+  std::coroutine_handle<> handle;
+  //! Flag set by both the completion and the suspension, so whichever comes
+  //! second resumes the coroutine.
+  std::atomic<bool> completed;
+
+public:
+  //! Deleted.
+  SendOperation(const SendOperation &) = delete;
+
+  //! Deleted.
+  SendOperation &operator=(const SendOperation &) = delete;
+
+  //! Construct an operation.
+  /*!
+    \param sender a sender driven by a cppiper::Reactor.
+    \param msg a message to send.
+    \param deadline time to give up at.
+   */
+  SendOperation(Sender &sender, std::string msg,
+                std::chrono::steady_clock::time_point deadline);
+
+  //! Never ready before suspending.
+  /*!
+    \return false.
+   */
+  bool await_ready(void) const noexcept;
+
+  //! Start sending.
+  /*!
+    \param handle the awaiting coroutine.
+    \return Whether or not the coroutine stays suspended (false if the send
+    failed straight away).
+   */
+  bool await_suspend(std::coroutine_handle<> handle);
+
+  //! Get the result.
+  /*!
+    \return Whether or not the message was written before the deadline.
+   */
+  bool await_resume(void);
+};
+
+//! Receive a message from a coroutine without blocking its thread.
+/*!
+  The coroutine suspends until a message is queued, the deadline passes or
+  the stream ends, and resumes on the receiver's reactor loop (see
+  cppiper::Receiver::receive_async()).
+  \param receiver a receiver driven by a cppiper::Reactor.
+  \param deadline time to give up at (time_point::max() to wait for the end
+  of the stream).
+  \return An awaitable resolving to the message, or to an empty optional.
+ */
+ReceiveOperation
+async_receive(Receiver &receiver,
+              std::chrono::steady_clock::time_point deadline =
+                  std::chrono::steady_clock::time_point::max());
+
+//! Receive a message from a coroutine without blocking its thread.
+/*!
+  \param receiver a receiver driven by a cppiper::Reactor.
+  \param timeout time to wait for a message.
+  \return An awaitable resolving to the message, or to an empty optional.
+ */
+ReceiveOperation async_receive(Receiver &receiver,
+                               std::chrono::nanoseconds timeout);
+
+//! Send a message from a coroutine without blocking its thread.
+/*!
+  The coroutine suspends until the message is written or the deadline
+  passes, and resumes on the sender's reactor loop (see
+  cppiper::Sender::send_async()).
+  \param sender a sender driven by a cppiper::Reactor.
+  \param msg a message to send.
+  \param deadline time to give up at (time_point::max() for none).
+  \return An awaitable resolving to whether or not the message was written.
+ */
+SendOperation async_send(Sender &sender, std::string msg,
+                         std::chrono::steady_clock::time_point deadline =
+                             std::chrono::steady_clock::time_point::max());
+
+//! Send a message from a coroutine without blocking its thread.
+/*!
+  \param sender a sender driven by a cppiper::Reactor.
+  \param msg a message to send.
+  \param timeout time to wait for the message to be written.
+  \return An awaitable resolving to whether or not the message was written.
+ */
+SendOperation async_send(Sender &sender, std::string msg,
+                         std::chrono::nanoseconds timeout);
+
+} // namespace cppiper
+
+#endif // COROUTINE_HH_
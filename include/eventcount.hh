@@ -0,0 +1,73 @@
+#ifndef EVENTCOUNT_HH_
+#define EVENTCOUNT_HH_
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace cppiper {
+
+//! Size of a cache line, used to pad shared atomics.
+const size_t CACHE_LINE_SIZE = 64;
+
+//! A futex backed event count for parking threads on lock-free structures.
+/*!
+  A waiter announces itself with prepare_wait(), re-checks its condition and
+  then either cancels or commits the wait. Notifiers only enter the kernel when
+  a waiter is actually parked.
+ */
+class EventCount {
+private:
+  //! Incremented by every notification that finds a waiter.
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch;
+  //! Number of threads between prepare_wait() and the end of their wait.
+  std::atomic<uint32_t> waiters;
+  //! Futex operations may be shared with other processes.
+  const bool process_shared;
+
+  //! Wake parked threads.
+  /*!
+    \param count maximum number of threads to wake.
+   */
+  void wake(int count);
+
+public:
+  //! Construct an event count.
+  /*!
+    \param process_shared whether the event count lives in memory shared with
+    other processes.
+   */
+  explicit EventCount(bool process_shared = false);
+
+  //! Announce an intent to wait.
+  /*!
+    \return Key to pass to commit_wait().
+   */
+  uint32_t prepare_wait(void);
+
+  //! Withdraw an intent to wait.
+  void cancel_wait(void);
+
+  //! Park until notified.
+  /*!
+    \param key key returned by prepare_wait().
+   */
+  void commit_wait(uint32_t key);
+
+  //! Park until notified or a timeout elapses.
+  /*!
+    \param key key returned by prepare_wait().
+    \param timeout maximum time to park for.
+    \return Whether or not the wait ended before the timeout elapsed.
+   */
+  bool commit_wait(uint32_t key, std::chrono::nanoseconds timeout);
+
+  //! Wake a single parked thread.
+  void notify_one(void);
+
+  //! Wake every parked thread.
+  void notify_all(void);
+};
+
+} // namespace cppiper
+
+#endif // EVENTCOUNT_HH_
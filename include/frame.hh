@@ -0,0 +1,164 @@
+#ifndef FRAME_HH_
+#define FRAME_HH_
+#include <cstddef>
+#include <cstdint>
+
+namespace cppiper {
+
+//! Wire format used to frame messages on a pipe.
+enum class WireFormat {
+  //! Legacy 8 character hex size header (wire format v1).
+  HEX = 1,
+  //! Fixed size binary header (wire format v2).
+  BINARY = 2,
+};
+
+//! First byte of every binary frame header (never an ASCII hex digit).
+const uint8_t FRAME_MAGIC = 0xC9;
+
+//! Highest binary wire format version understood by this library.
+const uint8_t FRAME_VERSION = 2;
+
+//! Size of a legacy hex frame header.
+const size_t HEX_HEADER_SIZE = 8;
+
+//! Size of a binary frame header.
+const size_t FRAME_HEADER_SIZE = 16;
+
+//! Largest payload a legacy hex frame header can describe.
+const uint64_t HEX_MAX_LENGTH = 0x7FFFFFFF;
+
+//! Binary frame header flags.
+enum FrameFlag : uint16_t {
+  //! The checksum field holds the CRC32C of the payload.
+  FLAG_CHECKSUM = 1 << 0,
+  //! The payload is a compressed block (see cppiper::compress_block()) and
+  //! the header is followed by its uncompressed length.
+  FLAG_COMPRESSED = 1 << 1,
+  //! The payload holds the bytes of a trivially copyable object and the
+  //! header is followed by its type tag (see cppiper::TypeTag).
+  FLAG_TYPED = 1 << 2,
+  //! The message is part of a request/response exchange and the header is
+  //! followed by its correlation identifier (see cppiper::Channel).
+  FLAG_CORRELATED = 1 << 3,
+};
+
+//! Flags understood by this library.
+const uint16_t FRAME_KNOWN_FLAGS =
+    FLAG_CHECKSUM | FLAG_COMPRESSED | FLAG_TYPED | FLAG_CORRELATED;
+
+//! Flags that add an extension word after the header, in flag bit order.
+/*!
+  A receiver cannot skip extension words it does not know about, so senders
+  must only set extension flags their peers understand.
+ */
+const uint16_t FRAME_EXTENSION_FLAGS =
+    FLAG_COMPRESSED | FLAG_TYPED | FLAG_CORRELATED;
+
+//! Size of a binary frame header extension word.
+const size_t FRAME_EXTENSION_SIZE = 8;
+
+//! Size of a binary frame header with every extension word.
+const size_t FRAME_MAX_HEADER_SIZE =
+    FRAME_HEADER_SIZE +
+    __builtin_popcount(FRAME_EXTENSION_FLAGS) * FRAME_EXTENSION_SIZE;
+
+//! A binary frame header.
+/*!
+  Headers are encoded in host byte order since both ends of a pipe live on the
+  same machine.
+ */
+struct FrameHeader {
+  //! Always cppiper::FRAME_MAGIC.
+  uint8_t magic;
+  //! Wire format version.
+  uint8_t version;
+  //! Combination of cppiper::FrameFlag values.
+  uint16_t flags;
+  //! CRC32C of the payload if cppiper::FLAG_CHECKSUM is set, otherwise 0.
+  uint32_t checksum;
+  //! Payload length in bytes.
+  uint64_t length;
+};
+
+static_assert(sizeof(FrameHeader) == FRAME_HEADER_SIZE,
+              "FrameHeader must be packed to FRAME_HEADER_SIZE bytes");
+
+//! Extension words following a binary frame header.
+struct FrameExtensions {
+  //! Uncompressed payload length (cppiper::FLAG_COMPRESSED).
+  uint64_t raw_length = 0;
+  //! Type tag of the payload (cppiper::FLAG_TYPED).
+  uint64_t type_tag = 0;
+  //! Correlation identifier of the message (cppiper::FLAG_CORRELATED).
+  uint64_t correlation_id = 0;
+};
+
+//! Encode a binary frame header.
+/*!
+  \param header a header to encode.
+  \param out a buffer of at least cppiper::FRAME_HEADER_SIZE bytes.
+ */
+void encode_header(const FrameHeader &header, char *out);
+
+//! Decode a binary frame header.
+/*!
+  \param in a buffer of at least cppiper::FRAME_HEADER_SIZE bytes.
+  \param header the decoded header.
+  \return Whether or not the buffer holds a binary frame header.
+ */
+bool decode_header(const char *in, FrameHeader &header);
+
+//! Get the size of the extension words a binary frame header carries.
+/*!
+  \param flags header flags.
+  \return Extension size in bytes.
+ */
+size_t extensions_size(uint16_t flags);
+
+//! Encode the extension words of a binary frame header.
+/*!
+  \param flags header flags.
+  \param extensions extension values.
+  \param out a buffer of at least extensions_size(flags) bytes.
+  \return Number of bytes encoded.
+ */
+size_t encode_extensions(uint16_t flags, const FrameExtensions &extensions,
+                         char *out);
+
+//! Decode the extension words of a binary frame header.
+/*!
+  \param flags header flags.
+  \param in a buffer of at least extensions_size(flags) bytes.
+  \param extensions the decoded extension values.
+ */
+void decode_extensions(uint16_t flags, const char *in,
+                       FrameExtensions &extensions);
+
+//! Encode a legacy hex frame header.
+/*!
+  \param length a payload length no greater than cppiper::HEX_MAX_LENGTH.
+  \param out a buffer of at least cppiper::HEX_HEADER_SIZE bytes.
+ */
+void encode_hex_header(uint64_t length, char *out);
+
+//! Decode a legacy hex frame header.
+/*!
+  \param in a buffer of at least cppiper::HEX_HEADER_SIZE bytes.
+  \param length the decoded payload length.
+  \return Whether or not the buffer holds a valid hex frame header.
+ */
+bool decode_hex_header(const char *in, uint64_t &length);
+
+//! Compute the CRC32C (Castagnoli) checksum of a buffer.
+/*!
+  \param data a buffer.
+  \param len the buffer length.
+  \param crc a previous checksum to continue from.
+  \return The checksum.
+ */
+uint32_t crc32c(const void *data, size_t len, uint32_t crc = 0);
+
+} // namespace cppiper
+
+#endif // FRAME_HH_
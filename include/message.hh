@@ -0,0 +1,131 @@
+#ifndef MESSAGE_HH_
+#define MESSAGE_HH_
+#include "typetag.hh"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cppiper {
+
+class BufferPool;
+
+//! A received message backed by a pooled buffer.
+/*!
+  Messages are move-only. The backing buffer is returned to its pool when the
+  message is destroyed, so holding on to messages holds on to pool memory.
+ */
+class Message {
+private:
+  //! Pool the buffer is returned to.
+  std::shared_ptr<BufferPool> pool;
+  //! Backing buffer.
+  std::unique_ptr<char[]> buffer;
+  //! Backing buffer capacity.
+  size_t capacity;
+  //! Payload size.
+  size_t length;
+  //! Type tag of a typed message (0 for untyped messages).
+  uint64_t tag;
+  //! Correlation identifier (0 for uncorrelated messages).
+  uint64_t correlation;
+
+  friend class BufferPool;
+  friend class Receiver;
+
+  //! Construct a message over a pooled buffer.
+  /*!
+    \param pool pool the buffer is returned to.
+    \param buffer backing buffer.
+    \param capacity backing buffer capacity.
+    \param length payload size.
+   */
+  Message(std::shared_ptr<BufferPool> pool, std::unique_ptr<char[]> buffer,
+          size_t capacity, size_t length);
+
+public:
+  //! Construct an empty message.
+  Message(void);
+
+  //! Deleted.
+  Message(const Message &) = delete;
+
+  //! Deleted.
+  Message &operator=(const Message &) = delete;
+
+  //! Move a message.
+  Message(Message &&other) noexcept;
+
+  //! Move assign a message, releasing any buffer currently held.
+  Message &operator=(Message &&other) noexcept;
+
+  //! Release the backing buffer to its pool.
+  ~Message(void);
+
+  //! Get the payload.
+  /*!
+    \return Pointer to the payload bytes.
+   */
+  const char *data(void) const;
+
+  //! Get the mutable payload.
+  /*!
+    \return Pointer to the payload bytes.
+   */
+  char *data(void);
+
+  //! Get the payload size.
+  /*!
+    \return Payload size in bytes.
+   */
+  size_t size(void) const;
+
+  //! Check whether the payload is empty.
+  /*!
+    \return Whether or not the payload is empty.
+   */
+  bool empty(void) const;
+
+  //! View the payload without copying it.
+  /*!
+    \return A view valid for the lifetime of this message.
+   */
+  std::string_view view(void) const;
+
+  //! Copy the payload into a string.
+  /*!
+    \return The payload.
+   */
+  std::string str(void) const;
+
+  //! Get the type tag of a typed message.
+  /*!
+    \return The cppiper::TypeTag value the sender attached, or 0 if the
+    message is untyped.
+   */
+  uint64_t type_tag(void) const;
+
+  //! Get the correlation identifier of a request or reply.
+  /*!
+    \return The identifier a cppiper::Channel attached, or 0 if the message is
+    uncorrelated.
+   */
+  uint64_t correlation_id(void) const;
+
+  //! View the payload as an object without copying it.
+  /*!
+    \return Pointer to the object valid for the lifetime of this message, or
+    nullptr if the message was not sent as a T.
+   */
+  template <typename T> const T *as(void) const {
+    check_wire_type<T>();
+    if (tag != TypeTag<std::remove_cv_t<T>>::value or length != sizeof(T))
+      return nullptr;
+    return std::launder(reinterpret_cast<const T *>(buffer.get()));
+  }
+};
+
+} // namespace cppiper
+
+#endif // MESSAGE_HH_
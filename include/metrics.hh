@@ -0,0 +1,214 @@
+#ifndef METRICS_HH_
+#define METRICS_HH_
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace cppiper {
+
+//! Role of an endpoint.
+enum class EndpointRole {
+  //! A cppiper::Sender.
+  SENDER,
+  //! A cppiper::Receiver.
+  RECEIVER,
+};
+
+//! A snapshot of the runtime counters of an endpoint.
+struct EndpointStats {
+  //! Process-wide endpoint identifier (see cppiper::TraceRecord::endpoint).
+  uint32_t id = 0;
+  //! Identifying name of the endpoint.
+  std::string name;
+  //! Path to the endpoint pipe.
+  std::filesystem::path pipe;
+  //! Role of the endpoint.
+  EndpointRole role = EndpointRole::SENDER;
+  //! Current status code of the endpoint.
+  int status_code = 0;
+  //! Messages written (sender) or frames decoded (receiver).
+  uint64_t messages = 0;
+  //! Bytes written to or read from the transport, frame headers included.
+  uint64_t bytes = 0;
+  //! Read, write and splice system calls issued on the pipe.
+  uint64_t syscalls = 0;
+  //! System calls that transferred fewer bytes than requested.
+  uint64_t short_transfers = 0;
+  //! System calls that failed with EAGAIN.
+  uint64_t eagain = 0;
+  //! System calls interrupted by a signal (EINTR).
+  uint64_t eintr = 0;
+  //! Messages currently queued.
+  uint64_t queue_depth = 0;
+  //! Most messages ever queued at once.
+  uint64_t max_queue_depth = 0;
+  //! Time spent blocked on flow control: callers waiting for outbound queue
+  //! space and the sender waiting for ring space, or the receiver waiting for
+  //! receive queue space.
+  uint64_t blocked_nanoseconds = 0;
+};
+
+//! Runtime counters of an endpoint.
+/*!
+  Counters are relaxed atomics, updated by the threads driving the endpoint
+  and read without locking, so every counter is exact but a snapshot is not a
+  consistent cut across counters.
+ */
+class EndpointCounters {
+private:
+  //! Process-wide endpoint identifier.
+  const uint32_t id;
+  //! Messages written or decoded.
+  std::atomic<uint64_t> messages;
+  //! Bytes transferred.
+  std::atomic<uint64_t> bytes;
+  //! System calls issued.
+  std::atomic<uint64_t> syscalls;
+  //! Short transfers.
+  std::atomic<uint64_t> short_transfers;
+  //! EAGAIN failures.
+  std::atomic<uint64_t> eagain;
+  //! EINTR failures.
+  std::atomic<uint64_t> eintr;
+  //! Last observed queue depth.
+  std::atomic<uint64_t> queue_depth;
+  //! Largest observed queue depth.
+  std::atomic<uint64_t> max_queue_depth;
+  //! Time spent blocked.
+  std::atomic<uint64_t> blocked_nanoseconds;
+
+public:
+  //! Construct zeroed counters with a new endpoint identifier.
+  EndpointCounters(void);
+
+  //! Get the endpoint identifier.
+  /*!
+    \return Identifier unique within the process.
+   */
+  uint32_t get_id(void) const;
+
+  //! Count messages.
+  /*!
+    \param count number of messages.
+   */
+  void count_messages(uint64_t count = 1);
+
+  //! Count transferred bytes.
+  /*!
+    \param count number of bytes.
+   */
+  void count_bytes(uint64_t count);
+
+  //! Count a read, write or splice system call.
+  /*!
+    \param result the value returned by the call (errno is inspected if
+    negative).
+    \param requested number of bytes requested (0 if partial transfers are
+    expected and should not count as short).
+   */
+  void count_syscall(ssize_t result, size_t requested);
+
+  //! Record the current queue depth.
+  /*!
+    \param depth number of messages queued.
+   */
+  void observe_depth(size_t depth);
+
+  //! Count time spent blocked.
+  /*!
+    \param duration blocked time.
+   */
+  void count_blocked(std::chrono::nanoseconds duration);
+
+  //! Get the number of messages counted.
+  /*!
+    \return Message count.
+   */
+  uint64_t get_messages(void) const;
+
+  //! Get the number of system calls counted.
+  /*!
+    \return System call count.
+   */
+  uint64_t get_syscalls(void) const;
+
+  //! Copy the counters into a snapshot.
+  /*!
+    \param stats snapshot to fill in (the name, pipe, role and status code are
+    left untouched).
+   */
+  void snapshot(EndpointStats &stats) const;
+};
+
+//! An endpoint whose counters can be enumerated by cppiper::MetricsRegistry.
+class MetricsSource {
+public:
+  //! Take a snapshot of the endpoint counters.
+  /*!
+    Must be safe to call from any thread for as long as the source is
+    registered.
+    \return Counter snapshot.
+   */
+  virtual EndpointStats stats(void) const = 0;
+
+protected:
+  ~MetricsSource(void) = default;
+};
+
+//! Process-wide registry of live endpoints.
+/*!
+  Senders and receivers register themselves on construction and unregister on
+  destruction, so monitoring can export the counters of every endpoint
+  without holding references to them.
+ */
+class MetricsRegistry {
+private:
+  //! Lock guarding the sources.
+  std::mutex lock;
+  //! Registered sources.
+  std::vector<const MetricsSource *> sources;
+
+  //! Construct an empty registry.
+  MetricsRegistry(void);
+
+public:
+  //! Deleted.
+  MetricsRegistry(const MetricsRegistry &) = delete;
+
+  //! Deleted.
+  MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+  //! Get the process-wide registry.
+  /*!
+    \return The registry.
+   */
+  static MetricsRegistry &instance(void);
+
+  //! Register an endpoint.
+  /*!
+    \param source an endpoint that outlives its registration.
+   */
+  void add(const MetricsSource *source);
+
+  //! Unregister an endpoint, waiting for snapshots in progress to finish.
+  /*!
+    \param source a registered endpoint.
+   */
+  void remove(const MetricsSource *source);
+
+  //! Take a snapshot of every registered endpoint.
+  /*!
+    \return Counter snapshots in registration order.
+   */
+  std::vector<EndpointStats> snapshot(void);
+};
+
+} // namespace cppiper
+
+#endif // METRICS_HH_
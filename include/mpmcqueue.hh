@@ -0,0 +1,144 @@
+#ifndef MPMCQUEUE_HH_
+#define MPMCQUEUE_HH_
+#include "eventcount.hh"
+#include "spscqueue.hh"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cppiper {
+
+//! A bounded lock-free multi-producer multi-consumer queue.
+/*!
+  Each slot carries a sequence number that tells producers and consumers
+  whether it is free or full for their lap around the ring (after Dmitry
+  Vyukov's bounded MPMC queue).
+ */
+template <typename T> class MPMCQueue {
+private:
+  //! A sequenced element slot, padded to a cache line.
+  struct alignas(CACHE_LINE_SIZE) Slot {
+    //! Lap counter for this slot.
+    std::atomic<size_t> sequence;
+    //! Uninitialised element storage.
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+
+    //! Get the stored element.
+    T *element(void) {
+      return std::launder(reinterpret_cast<T *>(&storage));
+    }
+  };
+
+  //! Slot count (a power of two).
+  const size_t capacity;
+  //! Mask mapping an index onto a slot.
+  const size_t mask;
+  //! Element storage.
+  const std::unique_ptr<Slot[]> slots;
+  //! Next index to push.
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+  //! Next index to pop.
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+
+public:
+  //! Construct a queue.
+  /*!
+    \param capacity minimum number of elements the queue can hold.
+   */
+  explicit MPMCQueue(size_t capacity)
+      : capacity(ring_capacity(capacity)), mask(this->capacity - 1),
+        slots(new Slot[this->capacity]), tail(0), head(0) {
+    for (size_t index = 0; index < this->capacity; index++)
+      slots[index].sequence.store(index, std::memory_order_relaxed);
+  }
+
+  //! Deleted.
+  MPMCQueue(const MPMCQueue &) = delete;
+
+  //! Deleted.
+  MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+  //! Destroy any elements left in the queue.
+  ~MPMCQueue(void) {
+    for (size_t index = head.load(); index != tail.load(); index++)
+      slots[index & mask].element()->~T();
+  }
+
+  //! Push an element.
+  /*!
+    \param value an element, moved from only on success.
+    \return Whether or not there was room for the element.
+   */
+  bool try_push(T &value) {
+    size_t index(tail.load(std::memory_order_relaxed));
+    while (true) {
+      Slot &slot(slots[index & mask]);
+      const size_t sequence(slot.sequence.load(std::memory_order_acquire));
+      const std::ptrdiff_t lap(static_cast<std::ptrdiff_t>(sequence - index));
+      if (lap == 0) {
+        if (tail.compare_exchange_weak(index, index + 1,
+                                       std::memory_order_relaxed)) {
+          new (&slot.storage) T(std::move(value));
+          slot.sequence.store(index + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        return false;
+      } else {
+        index = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  //! Pop an element.
+  /*!
+    \param value assigned the popped element.
+    \return Whether or not an element was available.
+   */
+  bool try_pop(T &value) {
+    size_t index(head.load(std::memory_order_relaxed));
+    while (true) {
+      Slot &slot(slots[index & mask]);
+      const size_t sequence(slot.sequence.load(std::memory_order_acquire));
+      const std::ptrdiff_t lap(
+          static_cast<std::ptrdiff_t>(sequence - (index + 1)));
+      if (lap == 0) {
+        if (head.compare_exchange_weak(index, index + 1,
+                                       std::memory_order_relaxed)) {
+          T *element(slot.element());
+          value = std::move(*element);
+          element->~T();
+          slot.sequence.store(index + capacity, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        return false;
+      } else {
+        index = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  //! Get the approximate number of queued elements.
+  /*!
+    \return Queue size.
+   */
+  size_t size(void) const {
+    const size_t pushed(tail.load(std::memory_order_acquire));
+    const size_t popped(head.load(std::memory_order_acquire));
+    return pushed > popped ? pushed - popped : 0;
+  }
+
+  //! Get the queue capacity.
+  /*!
+    \return Maximum number of elements.
+   */
+  size_t get_capacity(void) const { return capacity; }
+};
+
+} // namespace cppiper
+
+#endif // MPMCQUEUE_HH_
@@ -1,33 +1,91 @@
 #ifndef PIPEMANAGER_HH_
 #define PIPEMANAGER_HH_
+#include "shmring.hh"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
 #include <mutex>
-#include <sstream>
+#include <set>
 #include <string>
-#include <tuple>
-#include <filesystem>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 namespace cppiper {
 
 const size_t PIPE_LENGTH = 32;
 
+//! Default number of idle pipes kept by a cppiper::PipeManager pool.
+const size_t PIPE_POOL_LIMIT = 64;
+
 //! Generate a random hex string of a specified length.
 /*!
+  Uses a per-thread generator seeded once from std::random_device, so it is
+  safe to call concurrently and never needs a lock.
   \param len a specified length.
   \return The hex string.
  */
 std::string random_hex(int len);
 
+//! Get the process that generated a pipe name.
+/*!
+  Names generated by cppiper::PipeManager::make_pipe() start with the PID of
+  the generating process, so orphaned pipes can be told apart from live ones.
+  \param pipename name of pipe.
+  \return The PID, or 0 if the name was not generated by a pipe manager.
+ */
+pid_t pipe_owner(const std::string &pipename);
+
 //! A pipe managing class.
 /*!
   Manages the creation and removal of named pipes in a specific directory (pipe
-  directory).
+  directory). Pipes can be pre-created in a pool with reserve(), leased and
+  recycled, which takes mkfifo off the connection path. Pipes orphaned by
+  processes that died without removing them are reclaimed by collect(), on
+  demand or periodically on a collector thread.
  */
 class PipeManager {
 private:
-  //! Pipe directory lock.
+  //! Pipe directory and pool lock.
   std::mutex lock;
   //! Pipe directory path.
   const std::filesystem::path pipedir;
+  //! Most idle pipes kept in the pool.
+  const size_t pool_limit;
+  //! Idle pipes ready to be leased.
+  std::vector<std::filesystem::path> pool;
+  //! Pipes handed out by lease() and not yet recycled or removed.
+  std::set<std::filesystem::path> leased;
+  //! Collector thread lock.
+  std::mutex collector_lock;
+  //! Notified to stop the collector thread.
+  std::condition_variable collector_conditional;
+  //! Whether or not the collector thread should keep running.
+  bool collector_running;
+  //! Collector thread.
+  std::thread collector;
+
+  //! Get the path of a pipe in the pipe directory.
+  /*!
+    \param pipename name of pipe.
+    \return The path to the pipe.
+   */
+  std::filesystem::path pipe_path(const std::string &pipename) const;
+
+  //! Remove a pipe and its shared memory segment (pipe directory lock held).
+  /*!
+    \param pipepath path to the pipe.
+    \return Whether or not the pipe existed.
+   */
+  bool unlink_pipe(const std::filesystem::path &pipepath);
+
+  //! Collect orphaned pipes periodically until stop_collector() is called.
+  /*!
+    \param interval time between collections.
+    \param idle_ttl see collect().
+   */
+  void collect_loop(std::chrono::milliseconds interval,
+                    std::chrono::seconds idle_ttl);
 
 public:
   //! Deleted.
@@ -37,16 +95,25 @@ public:
   /*!
     \param pipedir a directory path for the pipes (this directory will be
     created if it does not exist).
+    \param pool_limit most idle pipes kept by recycle().
    */
-  PipeManager(const std::filesystem::path pipedir);
+  PipeManager(const std::filesystem::path pipedir,
+              size_t pool_limit = PIPE_POOL_LIMIT);
+
+  //! Stop the collector thread and remove the pipes left in the pool.
+  ~PipeManager(void);
 
   //! Make a new fifo pipe with a random name (of cppiper::PIPE_LENGTH length).
   /*!
+    The name is the PID of the process, a per-process counter and a random
+    suffix, so it never collides with a live pipe and needs no existence
+    check beyond mkfifo itself.
     \return The path to the pipe.
+    \throw filesystem_error if the pipe could not be created.
   */
   std::filesystem::path make_pipe(void);
 
-  //! Make a new fifo pipe with a random name (of cppiper::PIPE_LENGTH length).
+  //! Make a new fifo pipe with a given name.
   /*!
     \param pipename name for the new pipe.
     \return The path to the pipe.
@@ -54,14 +121,80 @@ public:
   */
   std::filesystem::path make_pipe(const std::string& pipename);
 
-  //! Remove a pipe from the pipe directory.
+  //! Pre-create pipes in the pool.
+  /*!
+    \param count number of idle pipes to have in the pool (capped at the pool
+    limit).
+    \return The number of idle pipes in the pool.
+   */
+  size_t reserve(size_t count);
+
+  //! Lease a pipe, taking an idle one from the pool if there is any.
+  /*!
+    \return The path to the pipe.
+    \throw filesystem_error if a new pipe could not be created.
+   */
+  std::filesystem::path lease(void);
+
+  //! Return a leased pipe to the pool, or remove it if the pool is full.
+  /*!
+    Both ends of the pipe must have been closed, so the next lease does not
+    connect to a stale peer. Its shared memory segment, if any, is kept and
+    reset by the next sender.
+    \param pipepath path to the pipe.
+    \return Whether or not the pipe was pooled.
+   */
+  bool recycle(const std::filesystem::path &pipepath);
+
+  //! Make the shared memory segment backing a pipe's
+  //! cppiper::Transport::SHARED_MEMORY transport.
+  /*!
+    Senders create the segment on demand, so this is only needed to reserve
+    the memory up front. The segment is removed along with the pipe.
+    \param pipename name of pipe.
+    \param capacity ring capacity in bytes.
+    \return Whether or not the segment exists.
+  */
+  bool make_segment(const std::string& pipename,
+                    size_t capacity = SHM_RING_CAPACITY);
+
+  //! Remove a pipe, and any shared memory segment backing it, from the pipe
+  //! directory.
   /*!
     \param pipename name of pipe.
     \return whether or not the removal was successful.
   */
   bool remove_pipe(const std::string& pipename);
 
-  //! Clear the pipe directory of pipes.
+  //! Remove orphaned pipes, and their shared memory segments, from the pipe
+  //! directory.
+  /*!
+    A pipe is orphaned if the process that generated its name (see
+    cppiper::pipe_owner()) is no longer running. With a non-zero idle TTL,
+    pipes of live owners, including other processes, that have not been
+    opened, read or written for that long are removed too. Pipes pooled in
+    or leased from this manager are never collected as idle, since a leased
+    pipe may still be waiting for its peer.
+    \param idle_ttl idle time after which a pipe is removed (0 to only remove
+    pipes of dead processes).
+    \return The number of pipes removed.
+   */
+  size_t collect(std::chrono::seconds idle_ttl = std::chrono::seconds(0));
+
+  //! Start collecting orphaned pipes periodically on a background thread.
+  /*!
+    \param interval time between collections.
+    \param idle_ttl see collect().
+    \return Whether or not the collector was started (false if it already
+    runs).
+   */
+  bool start_collector(std::chrono::milliseconds interval,
+                       std::chrono::seconds idle_ttl = std::chrono::seconds(0));
+
+  //! Stop the collector thread, if it runs.
+  void stop_collector(void);
+
+  //! Clear the pipe directory of pipes and their shared memory segments.
   void clear(void);
 };
 
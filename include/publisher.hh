@@ -0,0 +1,289 @@
+#ifndef PUBLISHER_HH_
+#define PUBLISHER_HH_
+#include "frame.hh"
+#include "pipemanager.hh"
+#include "reactor.hh"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cppiper {
+
+//! Policy applied to a subscriber that cannot keep up with a publisher.
+enum class SlowConsumerPolicy {
+  //! Skip messages that do not fit in the subscriber's buffer.
+  DROP,
+  //! Disconnect a subscriber whose buffer overflows.
+  DISCONNECT,
+};
+
+//! Options for a subscriber of a cppiper::Publisher.
+struct SubscriberOptions {
+  //! Bytes of unwritten messages buffered for the subscriber before its
+  //! policy applies.
+  size_t buffer_limit = 1 << 20;
+  //! Policy applied once the buffer is full.
+  SlowConsumerPolicy policy = SlowConsumerPolicy::DROP;
+};
+
+//! Options for constructing a publisher.
+struct PublisherOptions {
+  //! Wire format used to frame messages.
+  WireFormat wire_format = WireFormat::BINARY;
+  //! Attach a CRC32C checksum to binary frames.
+  bool checksum = false;
+  //! Reactor draining subscriber buffers (nullptr for a dedicated one).
+  Reactor *reactor = nullptr;
+  //! Options of subscribers added without their own.
+  SubscriberOptions subscriber;
+};
+
+//! A subscriber added to a cppiper::Publisher.
+struct Subscription {
+  //! Identifier to unsubscribe with.
+  uint64_t id = 0;
+  //! Pipe the subscriber receives on.
+  std::filesystem::path pipe;
+};
+
+//! A snapshot of the state of a subscriber.
+struct SubscriberStats {
+  //! Subscriber identifier.
+  uint64_t id = 0;
+  //! Pipe the subscriber receives on.
+  std::filesystem::path pipe;
+  //! Whether or not the subscriber has opened its end of the pipe.
+  bool connected = false;
+  //! Messages written, or buffered to be written, to the subscriber.
+  uint64_t delivered = 0;
+  //! Messages skipped by cppiper::SlowConsumerPolicy::DROP.
+  uint64_t dropped = 0;
+  //! Bytes buffered for the subscriber.
+  size_t buffered_bytes = 0;
+};
+
+//! A class broadcasting messages to any number of subscriber pipes.
+/*!
+  Each message is framed once and the frame is shared by every subscriber.
+  The publishing thread writes it to each pipe without blocking. Bytes a pipe
+  cannot take yet are buffered and written by a reactor loop once the
+  subscriber catches up, so a slow subscriber never delays the others.
+
+  Subscribers receive with a cppiper::Receiver on their pipe. They are
+  connected by the first publish after they open it, and only see messages
+  published from then on. Subscribers may join and leave at any time. A
+  subscriber that closes its pipe is removed by the next publish. The
+  publisher ignores SIGPIPE, unless the process already handles it, so that
+  this does not kill it.
+ */
+class Publisher {
+private:
+  //! A framed message shared by the subscribers it is written to.
+  struct Broadcast {
+    //! Encoded frame header and extension words.
+    char header[FRAME_MAX_HEADER_SIZE];
+    //! Encoded frame header size.
+    size_t header_size;
+    //! Message payload.
+    std::string payload;
+  };
+
+  //! A frame waiting to be written to a subscriber.
+  struct Pending {
+    //! The frame.
+    std::shared_ptr<const Broadcast> frame;
+    //! Number of frame bytes already written.
+    size_t written;
+  };
+
+  //! A subscriber pipe.
+  struct Subscriber : ReactorHandler {
+    //! Construct an unconnected subscriber.
+    Subscriber(uint64_t id, const std::filesystem::path &pipepath,
+               bool owned, const SubscriberOptions &options)
+        : id(id), pipepath(pipepath), owned(owned), options(options),
+          lock(), pipe_fd(-1), loop(-1), backlog(), backlog_bytes(0),
+          delivered(0), dropped(0), closing(false) {}
+    //! Write buffered frames once the pipe drains.
+    void handle_events(uint32_t events) override;
+    //! Write buffered frames until the pipe would block (lock held).
+    /*!
+      \return Whether or not the pipe is still open.
+     */
+    bool flush(void);
+    //! Subscriber identifier.
+    const uint64_t id;
+    //! Pipe path.
+    const std::filesystem::path pipepath;
+    //! Whether or not the pipe was made by the publisher's pipe manager.
+    const bool owned;
+    //! Subscriber options.
+    const SubscriberOptions options;
+    //! Lock guarding the pipe and its buffer.
+    std::mutex lock;
+    //! Pipe file descriptor (-1 until the subscriber opens its end).
+    int pipe_fd;
+    //! Index of the reactor loop the pipe is attached to.
+    int loop;
+    //! Frames waiting to be written.
+    std::deque<Pending> backlog;
+    //! Unwritten bytes of the buffered frames.
+    size_t backlog_bytes;
+    //! Messages written or buffered.
+    uint64_t delivered;
+    //! Messages dropped.
+    uint64_t dropped;
+    //! Flag used to signal the subscriber must be removed.
+    std::atomic<bool> closing;
+  };
+
+  //! Identifying name of this publisher instance (for debugging).
+  const std::string name;
+  //! Pipe manager making subscriber pipes.
+  PipeManager &pipemanager;
+  //! Construction options.
+  const PublisherOptions options;
+  //! Reactor owned by the publisher (if none was given).
+  std::unique_ptr<Reactor> own_reactor;
+  //! Reactor draining subscriber buffers.
+  Reactor *const reactor;
+  //! Identifier of the next subscriber.
+  std::atomic<uint64_t> next_id;
+  //! Lock guarding the subscribers, held while publishing.
+  std::mutex lock;
+  //! Subscribers by identifier.
+  std::map<uint64_t, std::shared_ptr<Subscriber>> subscribers;
+
+  //! Frame a message.
+  /*!
+    \param msg a message.
+    \return The frame, or nullptr if the message cannot be framed.
+   */
+  std::shared_ptr<const Broadcast> encode(std::string msg) const;
+
+  //! Open the publisher's end of a subscriber pipe if the subscriber has
+  //! opened its own (subscriber lock held).
+  /*!
+    \param subscriber a subscriber.
+    \return Whether or not the subscriber is connected.
+   */
+  bool connect(Subscriber &subscriber);
+
+  //! Write or buffer a frame for a subscriber.
+  /*!
+    \param subscriber a subscriber.
+    \param frame the frame.
+    \return Whether or not the frame was written or buffered.
+   */
+  bool deliver(Subscriber &subscriber,
+               const std::shared_ptr<const Broadcast> &frame);
+
+  //! Remove a subscriber, closing its pipe.
+  /*!
+    \param id subscriber identifier.
+    \return Whether or not the subscriber existed.
+   */
+  bool remove(uint64_t id);
+
+  //! Add a subscriber.
+  /*!
+    \param pipepath pipe the subscriber receives on.
+    \param owned whether the pipe is removed along with the subscriber.
+    \param options subscriber options.
+    \return The subscription.
+   */
+  Subscription add(const std::filesystem::path &pipepath, bool owned,
+                   const SubscriberOptions &options);
+
+public:
+  //! Deleted.
+  Publisher(void) = delete;
+
+  //! Deleted.
+  Publisher(const Publisher &) = delete;
+
+  //! Deleted.
+  Publisher &operator=(const Publisher &) = delete;
+
+  //! Construct a publisher.
+  /*!
+    \param name identifying name of this publisher instance (for debugging).
+    \param pipemanager pipe manager making subscriber pipes (must outlive
+    the publisher).
+    \param options publisher options.
+   */
+  Publisher(const std::string name, PipeManager &pipemanager,
+            const PublisherOptions &options = PublisherOptions());
+
+  //! Remove every subscriber.
+  ~Publisher(void);
+
+  //! Add a subscriber on a new pipe.
+  /*!
+    The pipe is leased from the pipe manager and removed when the subscriber
+    is.
+    \return The subscription.
+    \throw filesystem_error if the pipe could not be created.
+   */
+  Subscription subscribe(void);
+
+  //! Add a subscriber on a new pipe.
+  /*!
+    \param options subscriber options.
+    \return The subscription.
+    \throw filesystem_error if the pipe could not be created.
+   */
+  Subscription subscribe(const SubscriberOptions &options);
+
+  //! Add a subscriber on an existing pipe.
+  /*!
+    \param pipepath pipe the subscriber receives on (kept when the
+    subscriber is removed).
+    \param options subscriber options.
+    \return The subscription.
+   */
+  Subscription subscribe(const std::filesystem::path &pipepath,
+                         const SubscriberOptions &options);
+
+  //! Remove a subscriber.
+  /*!
+    Messages still buffered for it are dropped and its pipe is closed, so
+    the subscriber sees the end of the stream after the messages already
+    written.
+    \param id subscriber identifier.
+    \return Whether or not the subscriber existed.
+   */
+  bool unsubscribe(uint64_t id);
+
+  //! Broadcast a message to every connected subscriber.
+  /*!
+    Never blocks on a subscriber. Concurrent publishes are serialised, so
+    every subscriber sees messages in the same order.
+    \param msg a message.
+    \return The number of subscribers the message was written or buffered
+    for.
+   */
+  size_t publish(std::string msg);
+
+  //! Get the number of subscribers.
+  /*!
+    \return Subscriber count.
+   */
+  size_t subscriber_count(void);
+
+  //! Take a snapshot of every subscriber.
+  /*!
+    \return Subscriber snapshots by identifier.
+   */
+  std::vector<SubscriberStats> get_subscriber_stats(void);
+};
+
+} // namespace cppiper
+
+#endif // PUBLISHER_HH_
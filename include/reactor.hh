@@ -0,0 +1,198 @@
+#ifndef REACTOR_HH_
+#define REACTOR_HH_
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cppiper {
+
+//! An object whose file descriptor is serviced by a cppiper::Reactor.
+class ReactorHandler {
+public:
+  virtual ~ReactorHandler(void) = default;
+
+  //! Handle readiness of the attached file descriptor.
+  /*!
+    Called on the loop thread the descriptor is attached to.
+    \param events epoll event mask.
+   */
+  virtual void handle_events(uint32_t events) = 0;
+};
+
+//! A timer scheduled on a cppiper::Reactor loop.
+struct ReactorTimer {
+  //! Index of the loop the timer runs on (-1 if it was never scheduled).
+  int loop = -1;
+  //! Time the timer expires.
+  std::chrono::steady_clock::time_point deadline;
+  //! Identifier unique within the reactor.
+  uint64_t id = 0;
+};
+
+//! Get the deadline a timeout expires at.
+/*!
+  \param timeout a timeout (std::chrono::nanoseconds::max() for none).
+  \return The deadline (time_point::max() for none).
+ */
+std::chrono::steady_clock::time_point
+deadline_after(std::chrono::nanoseconds timeout);
+
+//! An epoll event loop engine servicing many pipe endpoints on a few threads.
+/*!
+  Senders and receivers constructed with a reactor open their pipe in
+  non-blocking mode and are driven by one of the reactor's loop threads instead
+  of a thread of their own. Every endpoint must be terminated or waited on
+  before its reactor is destroyed.
+ */
+class Reactor {
+private:
+  //! A single event loop.
+  struct Loop {
+    //! Epoll instance.
+    int epoll_fd;
+    //! Event descriptor used to wake the loop for posted tasks.
+    int event_fd;
+    //! Lock guarding the task list.
+    std::mutex lock;
+    //! Tasks posted to the loop.
+    std::vector<std::function<void()>> tasks;
+    //! Tasks run once their timer expires, by deadline and identifier.
+    std::map<std::pair<std::chrono::steady_clock::time_point, uint64_t>,
+             std::function<void()>>
+        timers;
+    //! Number of scheduled timers (read without the lock).
+    std::atomic<size_t> timer_count;
+    //! Loop thread.
+    std::thread thread;
+  };
+
+  //! Event loops.
+  std::vector<std::unique_ptr<Loop>> loops;
+  //! Index of the loop the next descriptor is attached to.
+  std::atomic<size_t> next_loop;
+  //! Flag used to stop the loops.
+  std::atomic<bool> stopping;
+  //! Identifier of the next timer.
+  std::atomic<uint64_t> next_timer;
+
+  //! Loop thread run method.
+  /*!
+    \param loop the loop to run.
+   */
+  void run(Loop &loop);
+
+  //! Get the time a loop may wait for events before its next timer expires.
+  /*!
+    \param loop a loop.
+    \return Timeout in milliseconds (-1 if the loop has no timers).
+   */
+  int next_timeout(Loop &loop);
+
+  //! Run the expired timers of a loop.
+  /*!
+    \param loop a loop.
+   */
+  void run_timers(Loop &loop);
+
+public:
+  //! Deleted.
+  Reactor(const Reactor &) = delete;
+
+  //! Deleted.
+  Reactor &operator=(const Reactor &) = delete;
+
+  //! Construct a reactor and start its loops.
+  /*!
+    \param loop_count number of event loop threads (defaults to one per core).
+   */
+  explicit Reactor(size_t loop_count = std::thread::hardware_concurrency());
+
+  //! Stop and join every loop.
+  ~Reactor(void);
+
+  //! Choose the loop the next file descriptor should be attached to.
+  /*!
+    Loops are chosen round robin.
+    \return Index of a loop (-1 if the reactor has no loops).
+   */
+  int choose_loop(void);
+
+  //! Attach a file descriptor to a loop.
+  /*!
+    \param loop index of a loop returned by choose_loop().
+    \param fd a file descriptor.
+    \param events epoll event mask to watch for.
+    \param handler handler invoked on readiness.
+    \return Whether or not the descriptor was attached.
+   */
+  bool attach(int loop, int fd, uint32_t events, ReactorHandler *handler);
+
+  //! Change the events watched on an attached file descriptor.
+  /*!
+    \param loop index of the loop the descriptor is attached to.
+    \param fd a file descriptor.
+    \param events epoll event mask to watch for.
+    \param handler handler invoked on readiness.
+    \return Whether or not the change was successful.
+   */
+  bool modify(int loop, int fd, uint32_t events, ReactorHandler *handler);
+
+  //! Detach a file descriptor, waiting until its handler can no longer run.
+  /*!
+    \param loop index of the loop the descriptor is attached to.
+    \param fd a file descriptor.
+   */
+  void detach(int loop, int fd);
+
+  //! Run a task on a loop thread.
+  /*!
+    Tasks run after the readiness events of the current loop iteration.
+    \param loop index of a loop.
+    \param task a task.
+   */
+  void post(int loop, std::function<void()> task);
+
+  //! Run a task on a loop thread and wait for it to complete.
+  /*!
+    \param loop index of a loop.
+    \param task a task.
+   */
+  void run_sync(int loop, std::function<void()> task);
+
+  //! Run a task on a loop thread once a deadline has passed.
+  /*!
+    Timers run after the readiness events and posted tasks of the loop
+    iteration they expire in, with millisecond resolution.
+    \param loop index of a loop.
+    \param deadline time the task should run at.
+    \param task a task.
+    \return The timer, to cancel it with.
+   */
+  ReactorTimer add_timer(int loop,
+                         std::chrono::steady_clock::time_point deadline,
+                         std::function<void()> task);
+
+  //! Cancel a timer that has not run yet.
+  /*!
+    \param timer a timer returned by add_timer().
+    \return Whether or not the timer was cancelled before it ran.
+   */
+  bool cancel_timer(const ReactorTimer &timer);
+
+  //! Get the number of event loops.
+  /*!
+    \return Loop count.
+   */
+  size_t get_loop_count(void) const;
+};
+
+} // namespace cppiper
+
+#endif // REACTOR_HH_
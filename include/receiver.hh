@@ -1,9 +1,24 @@
 #ifndef RECEIVER_HH_
 #define RECEIVER_HH_
-#include <condition_variable>
+#include "bufferpool.hh"
+#include "codec.hh"
+#include "eventcount.hh"
+#include "frame.hh"
+#include "message.hh"
+#include "metrics.hh"
+#include "mpmcqueue.hh"
+#include "reactor.hh"
+#include "shmring.hh"
+#include "spscqueue.hh"
+#include "tuning.hh"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <queue>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -12,52 +27,594 @@
 
 namespace cppiper {
 
+//! Default largest message a receiver accepts.
+const uint64_t MAX_MESSAGE_SIZE_DEFAULT = 1 << 28;
+
+//! Chooses where a large frame body is spliced to.
+/*!
+  Called on the receiver thread with the body length of every frame of at
+  least cppiper::ReceiverOptions::splice_threshold bytes. Returns a file or
+  socket descriptor to splice the body into, or -1 to receive the message
+  normally. Spliced bodies are never queued and their checksums are not
+  verified. A body has been fully written once the next message is received or
+  wait() returns; the descriptor is not closed by the receiver.
+ */
+using SpliceSink = std::function<int(uint64_t length)>;
+
+//! A callable invoked when the receive queue crosses a watermark.
+/*!
+  Called on the receiver thread (or reactor loop) with the number of queued
+  messages and payload bytes at the time of the crossing.
+ */
+using WatermarkCallback = std::function<void(size_t messages, size_t bytes)>;
+
+//! Options for constructing a receiver.
+struct ReceiverOptions {
+  //! Maximum number of received messages held for consumers.
+  size_t queue_capacity = 8192;
+  //! Largest frame payload, and uncompressed payload, accepted from the
+  //! pipe. A frame claiming more fails the receiver with EPROTO instead of
+  //! allocating its length.
+  uint64_t max_message_size = MAX_MESSAGE_SIZE_DEFAULT;
+  //! Stop reading from the pipe once this many messages are queued (0 for
+  //! the queue capacity). Messages decoded by the read that crosses a high
+  //! watermark are still queued.
+  size_t high_watermark = 0;
+  //! Resume reading once no more than this many messages are queued (0 for
+  //! half the high watermark).
+  size_t low_watermark = 0;
+  //! Stop reading from the pipe once this many payload bytes are queued (0
+  //! for no limit).
+  size_t high_watermark_bytes = 0;
+  //! Resume reading once no more than this many payload bytes are queued (0
+  //! for half the high watermark).
+  size_t low_watermark_bytes = 0;
+  //! Invoked when reading stops at a high watermark.
+  WatermarkCallback on_high_watermark;
+  //! Invoked when reading resumes at the low watermarks.
+  WatermarkCallback on_low_watermark;
+  //! Allow several threads to call receive() concurrently (uses a
+  //! multi-consumer queue).
+  bool shared_consumers = false;
+  //! Number of worker threads a message handler is dispatched on (0 runs the
+  //! handler on the receiver thread).
+  size_t dispatch_threads = 0;
+  //! Reactor driving the receiver (nullptr for a dedicated receiver thread).
+  Reactor *reactor = nullptr;
+  //! Transport carrying message bytes (must match the sender's).
+  Transport transport = Transport::FIFO;
+  //! Chooses descriptors large frame bodies are spliced into (empty to
+  //! receive every message normally).
+  SpliceSink sink;
+  //! Frames with bodies of at least this many bytes are offered to the sink.
+  size_t splice_threshold = 1 << 20;
+  //! Kernel buffer size requested for the pipe (0 keeps the kernel default).
+  size_t pipe_capacity = 0;
+  //! Read buffer size (0 to adapt it to the observed message sizes).
+  size_t chunk_size = 0;
+  //! Time to wait for a sender to open the pipe before failing with
+  //! ETIMEDOUT (0 to wait indefinitely).
+  std::chrono::milliseconds connect_timeout = std::chrono::milliseconds(0);
+  //! Return from the constructor straight away and wait for a sender in the
+  //! background (see cppiper::Receiver::connected()).
+  bool async_connect = false;
+  //! How the receiver thread waits for pipe data, and how receive() waits
+  //! for messages. Strategies other than cppiper::WaitStrategy::PARK make
+  //! the receiver thread's pipe non-blocking.
+  WaitStrategy wait_strategy = WaitStrategy::PARK;
+  //! Time spent spinning before parking with
+  //! cppiper::WaitStrategy::SPIN_THEN_PARK.
+  std::chrono::nanoseconds spin_budget = SPIN_BUDGET_DEFAULT;
+  //! Placement and scheduling of the receiver thread (thread mode only).
+  ThreadOptions thread_options;
+};
+
+//! A callable invoked with each received message.
+/*!
+  The message is borrowed: its buffer is returned to the pool once the handler
+  returns, so handlers must copy out anything they keep.
+ */
+using MessageHandler = std::function<void(const Message &)>;
+
+//! A callable completing a cppiper::Receiver::receive_async() call.
+/*!
+  Invoked with the message, or with an empty optional if the deadline passed
+  or the stream ended first.
+ */
+using ReceiveCallback = std::function<void(std::optional<Message>)>;
+
 //! A class responsible for receiving messages.
-class Receiver {
+class Receiver : private ReactorHandler, private MetricsSource {
 private:
   //! Identifying name of this receiver instance (for debugging).
   const std::string name;
   //! Path to the receiver pipe.
   const std::filesystem::path pipepath;
-  //! Buffering limit.
-  const int buffering_limit;
+  //! Construction options.
+  const ReceiverOptions options;
+  //! Handler invoked for each message (empty in queueing mode).
+  const MessageHandler handler;
+  //! Sizes the read buffer.
+  ChunkSizer chunk_sizer;
+  //! Reactor driving the receiver (nullptr in thread mode).
+  Reactor *const reactor;
+  //! Index of the reactor loop the pipe is attached to.
+  int loop;
   //! Receiver loop is running.
-  bool running;
+  std::atomic<bool> running;
   //! Code representing current status of receiver thread.
-  int statuscode;
+  std::atomic<int> statuscode;
   //! Receiver pipe file descriptor.
   int pipe_fd;
-  //! Queue of received messages.
-  std::queue<std::string> msg_queue;
-  //! Queue lock for the queue conditional.
-  std::mutex queue_lock;
-  //! Conditional used to synchronise with the message queue.
-  std::condition_variable queue_condition;
-  //! Sender thread.
+  //! Flag used to signal a sender has opened the pipe.
+  std::atomic<bool> pipe_open;
+  //! Promise resolved once a sender opens the pipe or fails to in time.
+  std::promise<bool> connect_promise;
+  //! Future of the connect promise.
+  std::shared_future<bool> connect_future;
+  //! Progress of a receiver connecting in the background.
+  enum ConnectState : int {
+    //! Waiting for a sender to open the pipe.
+    CONNECTING,
+    //! A sender opened the pipe in time.
+    CONNECTED,
+    //! The connect timeout passed first.
+    EXPIRED,
+  };
+  //! Progress of connecting in the background (a ConnectState).
+  std::atomic<int> connect_state;
+  //! Flag used to signal the blocking open of the pipe has returned.
+  std::atomic<bool> open_returned;
+  //! Shared memory ring (cppiper::Transport::SHARED_MEMORY only).
+  std::unique_ptr<ShmRing> ring;
+  //! Flag used to signal the ring ran dry and a wakeup was requested.
+  bool ring_idle;
+  //! Spinner of the receiver thread while the pipe is empty.
+  SpinWait idle_spinner;
+  //! Pool of buffers backing received messages.
+  std::shared_ptr<BufferPool> pool;
+  //! Buffer the pipe is read into.
+  std::unique_ptr<char[]> read_buffer;
+  //! Read buffer capacity.
+  size_t read_capacity;
+  //! Offset of the first undecoded byte in the read buffer.
+  size_t read_head;
+  //! Offset one past the last read byte in the read buffer.
+  size_t read_tail;
+  //! Header of the frame currently being decoded.
+  FrameHeader pending_header;
+  //! Header extensions of the frame currently being decoded.
+  FrameExtensions pending_extensions;
+  //! Message the current frame body is decoded into.
+  Message pending;
+  //! Number of body bytes decoded into the pending message.
+  size_t pending_filled;
+  //! Flag used to signal a frame body is being decoded.
+  bool body_pending;
+  //! Descriptor the pending frame body is spliced into (-1 when decoding into
+  //! the pending message).
+  int sink_fd;
+  //! Messages decoded by the current read, waiting to be queued.
+  std::vector<Message> decoded;
+  //! Index of the first decoded message not yet queued.
+  size_t decoded_index;
+  //! Stop reading once this many messages are queued.
+  const size_t high_watermark;
+  //! Resume reading once no more than this many messages are queued.
+  const size_t low_watermark;
+  //! Stop reading once this many payload bytes are queued (0 for no limit).
+  const size_t high_watermark_bytes;
+  //! Resume reading once no more than this many payload bytes are queued.
+  const size_t low_watermark_bytes;
+  //! Number of messages in the queue.
+  std::atomic<size_t> queued_msg_count;
+  //! Number of payload bytes in the queue.
+  std::atomic<size_t> queued_byte_count;
+  //! Flag used to signal reads are stopped at a high watermark.
+  std::atomic<bool> throttled;
+  //! Flag used to signal reads are paused on a full queue (reactor mode).
+  std::atomic<bool> paused;
+  //! Time reads were last paused (reactor mode).
+  std::chrono::steady_clock::time_point pause_start;
+  //! Flag used to signal a resume is scheduled (reactor mode).
+  std::atomic<bool> resume_pending;
+  //! Runtime counters.
+  EndpointCounters counters;
+  //! Decompression counters.
+  CompressionStats decompression_stats;
+  //! Lock guarding the decompression counters.
+  mutable std::mutex stats_lock;
+  //! Queue of received messages (single consumer).
+  std::unique_ptr<SPSCQueue<Message>> spsc_queue;
+  //! Queue of received messages (shared consumers).
+  std::unique_ptr<MPMCQueue<Message>> mpmc_queue;
+  //! Event consumers park on while the queue is empty.
+  EventCount consumer_event;
+  //! Event the receiver thread parks on while the queue is full.
+  EventCount producer_event;
+  //! Receiver thread (connecting thread in reactor mode).
   std::thread thread;
+  //! Thread expiring a background connect once its timeout passes.
+  std::thread connect_watchdog;
+  //! Handler dispatch threads.
+  std::vector<std::thread> workers;
+
+  //! An asynchronous receive waiting for a message.
+  struct AsyncReceive {
+    //! Callback completing the receive.
+    ReceiveCallback callback;
+    //! Lock serialising the completion with the deadline.
+    std::mutex lock;
+    //! Flag used to signal the receive has completed.
+    bool done = false;
+    //! Timer enforcing the deadline (never scheduled without one).
+    ReactorTimer timer;
+  };
+
+  //! Lock guarding the asynchronous receives, held while they take messages.
+  std::mutex async_lock;
+  //! Asynchronous receives in call order.
+  std::deque<std::shared_ptr<AsyncReceive>> async_receives;
+  //! Flag used to signal asynchronous receives are waiting.
+  std::atomic<bool> async_waiting;
 
   //! Receiver thread run method.
   void run();
 
+  //! Receiver thread run method when connecting in the background.
+  /*!
+    Opens the pipe, blocking until a sender opens it or the connect expires,
+    then runs the receiver loop (thread mode) or returns once the pipe is
+    attached to the reactor.
+   */
+  void run_connect(void);
+
+  //! Set up the open pipe for reading, and attach it to the reactor in
+  //! reactor mode.
+  /*!
+    \return Whether or not the pipe is ready.
+   */
+  bool connect(void);
+
+  //! Expire a background connect whose timeout passed.
+  /*!
+    Wakes the blocking open by opening the write end of the pipe.
+    \return Whether or not the open was woken or has returned (false if it
+    has not started yet, so the caller retries).
+   */
+  bool expire_connect(void);
+
+  //! Connect watchdog run method.
+  void watch_connect(void);
+
+  //! Read stream bytes from the pipe or the shared memory ring.
+  /*!
+    With the shared memory transport the pipe is only read to wait for the
+    sender, once the ring is empty.
+    \param dest buffer to read into.
+    \param len buffer size.
+    \return Number of bytes read, 0 at end of stream or -1 on error (with
+    errno set).
+   */
+  ssize_t read_stream(char *dest, size_t len);
+
+  //! Wait for a non-blocking pipe to become readable (thread mode).
+  void wait_readable(void);
+
+  //! Issue a single read on the pipe and queue every decoded message.
+  /*!
+    Bodies too large for the read buffer are read straight into their message
+    buffer.
+    \return Whether or not the pipe is still open and decodable.
+   */
+  bool fill(void);
+
+  //! Decode every complete frame in the read buffer.
+  /*!
+    \return Whether or not the stream is still decodable.
+   */
+  bool decode(void);
+
+  //! Write decoded body bytes to the sink descriptor.
+  /*!
+    \param data body bytes.
+    \param len number of body bytes.
+    \return Whether or not every byte was written.
+   */
+  bool write_sink(const char *data, size_t len);
+
+  //! Replace the pending message by its decompressed payload.
+  /*!
+    \return Whether or not the payload decompressed to its announced length.
+   */
+  bool decompress(void);
+
+  //! Validate the pending message and hand it to the handler or stage it for
+  //! queueing.
+  void deliver(void);
+
+  //! Invoke the handler on a message, containing any exception it throws.
+  /*!
+    \param msg a message.
+   */
+  void handle(const Message &msg);
+
+  //! Handler dispatch thread run method.
+  void dispatch(void);
+
+  //! Log a received message that does not hold the requested type.
+  /*!
+    \param msg the rejected message.
+    \param type_tag type tag of the requested type.
+    \param size size of the requested type.
+   */
+  void reject_type(const Message &msg, uint64_t type_tag, size_t size) const;
+
+  //! Queue a message for consumers.
+  /*!
+    In thread mode this parks while the queue is full; in reactor mode it fails
+    instead.
+    \param msg a message, moved from on success.
+    \return Whether or not the message was queued.
+   */
+  bool push(Message &msg);
+
+  //! Queue every staged decoded message.
+  /*!
+    \return Whether or not every staged message was queued.
+   */
+  bool queue_decoded(void);
+
+  //! Check whether the queue has reached a high watermark.
+  /*!
+    \return Whether or not reads must stop.
+   */
+  bool above_high_watermark(void) const;
+
+  //! Check whether the queue has drained to the low watermarks.
+  /*!
+    \return Whether or not reads may resume.
+   */
+  bool below_low_watermark(void) const;
+
+  //! Start or stop throttling reads as the queue crosses its watermarks.
+  /*!
+    \return Whether or not reads may continue.
+   */
+  bool update_throttle(void);
+
+  //! Wait until the queue has room for more reads (pauses in reactor mode).
+  void wait_for_room(void);
+
+  //! Wake the receiver after consumers freed queue space.
+  void notify_producer(void);
+
+  //! Stop reading from the pipe until the queue has room (reactor mode).
+  void pause(void);
+
+  //! Queue staged messages and resume reading if paused (reactor mode).
+  /*!
+    \return Whether or not reads were resumed.
+   */
+  bool resume(void);
+
+  //! Stop receiving and release consumers once the pipe has closed.
+  void finish(void);
+
+  //! Handle pipe readability (reactor mode).
+  /*!
+    \param events epoll event mask.
+   */
+  void handle_events(uint32_t events) override;
+
+  //! Take a message off the queue without blocking.
+  /*!
+    The receiver is not woken; callers must call notify_producer().
+    \param msg assigned the message.
+    \return Whether or not a message was available.
+   */
+  bool try_pop(Message &msg);
+
+  //! Take a message off the queue, waiting up to a timeout for one to arrive.
+  /*!
+    \param msg assigned the message.
+    \param timeout maximum time to wait (zero to not wait,
+    std::chrono::nanoseconds::max() to wait indefinitely).
+    \return Whether or not a message was taken.
+   */
+  bool pop(Message &msg, std::chrono::nanoseconds timeout);
+
+  //! Hand queued messages to waiting asynchronous receives, and end them all
+  //! once the stream has ended (async lock held).
+  /*!
+    Callbacks are posted to the reactor loop rather than invoked in place.
+   */
+  void serve_receives(void);
+
 public:
   //! Deleted.
   Receiver(void) = delete;
 
   //! Construct a receiver.
   /*!
+    Blocks until a sender opens the pipe, unless
+    cppiper::ReceiverOptions::async_connect is set.
+    \param name identifying name of this receiver instance (for debugging).
+    \param pipepath path to the receiver pipe.
+    \param options receiver options.
+   */
+  Receiver(const std::string name, const std::filesystem::path pipepath,
+           const ReceiverOptions &options = ReceiverOptions());
+
+  //! Construct a receiver that invokes a handler for each message.
+  /*!
+    The handler runs on the receiver thread, or on
+    cppiper::ReceiverOptions::dispatch_threads worker threads if set, and
+    receive() never returns a message.
     \param name identifying name of this receiver instance (for debugging).
     \param pipepath path to the receiver pipe.
+    \param handler a handler invoked with each received message.
+    \param options receiver options.
    */
-  Receiver(const std::string name, const std::filesystem::path pipepath);
+  Receiver(const std::string name, const std::filesystem::path pipepath,
+           MessageHandler handler,
+           const ReceiverOptions &options = ReceiverOptions());
+
+  //! Unregister the receiver from the cppiper::MetricsRegistry.
+  ~Receiver(void);
+
+  //! Get the receiver thread's current status code.
+  /*!
+    \return The current status code.
+   */
+  int get_status_code(void) const;
+
+  //! Get the outcome of waiting for a sender.
+  /*!
+    \return A future resolving to whether or not a sender opened the pipe
+    (false once the connect timeout passed).
+   */
+  std::shared_future<bool> connected(void) const;
 
   //! Receive a message.
   /*!
+    Only one thread may receive at a time unless
+    cppiper::ReceiverOptions::shared_consumers is set.
     \param wait block until a message is available.
     \return An optional that contains a message if one was available.
    */
-  std::optional<const std::string> receive(bool wait);
+  std::optional<Message> receive(bool wait);
+
+  //! Receive a message, waiting up to a timeout for one to arrive.
+  /*!
+    \param timeout maximum time to wait (zero to not wait,
+    std::chrono::nanoseconds::max() to wait indefinitely).
+    \return An optional that contains a message if one arrived in time.
+   */
+  std::optional<Message> receive(std::chrono::nanoseconds timeout);
+
+  //! Receive a message, waiting until a deadline for one to arrive.
+  /*!
+    \param deadline time to give up at (time_point::max() to wait
+    indefinitely).
+    \return An optional that contains a message if one arrived in time.
+   */
+  std::optional<Message>
+  receive(std::chrono::steady_clock::time_point deadline);
+
+  //! Receive a message without blocking the calling thread.
+  /*!
+    Requires a receiver driven by a cppiper::Reactor. The callback runs on
+    the receiver's reactor loop once a message is queued, or once the
+    deadline passes or the stream ends with no message left. It runs in
+    place if a message is already queued and no other asynchronous receive
+    is waiting. Asynchronous receives complete in call order. Mixing them
+    with receive() from other threads requires
+    cppiper::ReceiverOptions::shared_consumers.
+    \param callback invoked exactly once with the message, or with an empty
+    optional.
+    \param deadline time to give up at (time_point::max() to wait for the
+    end of the stream).
+   */
+  void receive_async(ReceiveCallback callback,
+                     std::chrono::steady_clock::time_point deadline =
+                         std::chrono::steady_clock::time_point::max());
+
+  //! Receive an object sent with cppiper::Sender::send() as a T.
+  /*!
+    A message that was not sent as a T (untyped, or carrying another type
+    tag or size) is dropped rather than misread. Use receive() and
+    cppiper::Message::as() to view received objects in place instead of
+    copying them out.
+    \param wait block until a message is available.
+    \return An optional that contains the object if a message holding a T was
+    available.
+   */
+  template <typename T> std::optional<T> receive(bool wait) {
+    check_wire_type<T>();
+    std::optional<Message> msg(receive(wait));
+    if (not msg)
+      return {};
+    const T *object(msg->as<T>());
+    if (not object) {
+      reject_type(*msg, TypeTag<T>::value, sizeof(T));
+      return {};
+    }
+    return *object;
+  }
+
+  //! Receive a batch of messages.
+  /*!
+    Waits up to the timeout for at least one message, then moves every
+    available message (up to the maximum) into the output container.
+    \param out container the messages are appended to.
+    \param max maximum number of messages to receive.
+    \param timeout maximum time to wait for the first message (zero to not
+    wait, std::chrono::nanoseconds::max() to wait indefinitely).
+    \return Number of messages received.
+   */
+  size_t receive_many(std::vector<Message> &out, size_t max,
+                      std::chrono::nanoseconds timeout =
+                          std::chrono::nanoseconds::zero());
+
+  //! Receive every message currently available without blocking.
+  /*!
+    \param out container the messages are appended to.
+    \return Number of messages received.
+   */
+  size_t drain(std::vector<Message> &out);
+
+  //! Get the number of messages waiting to be received.
+  /*!
+    \return Receive queue size.
+   */
+  size_t queue_size(void) const;
+
+  //! Get the number of payload bytes waiting to be received.
+  /*!
+    \return Queued payload bytes.
+   */
+  size_t queued_bytes(void) const;
+
+  //! Get the number of frames decoded from the pipe.
+  /*!
+    \return Frame count.
+   */
+  uint64_t get_msg_count(void) const;
+
+  //! Get the kernel buffer size of the pipe.
+  /*!
+    \return Pipe capacity in bytes (0 if the pipe is not open).
+   */
+  size_t get_pipe_capacity(void) const;
+
+  //! Get the current read buffer size.
+  /*!
+    \return Chunk size in bytes.
+   */
+  size_t get_chunk_size(void) const;
+
+  //! Get the decompression counters.
+  /*!
+    \return Counters of the frames decompressed so far.
+   */
+  CompressionStats get_decompression_stats(void) const;
+
+  //! Get the number of read system calls issued on the pipe.
+  /*!
+    \return Read system call count.
+   */
+  uint64_t get_read_count(void) const;
+
+  //! Take a snapshot of the runtime counters.
+  /*!
+    Lock-free, so it may be called from any thread at any rate.
+    \return Counter snapshot.
+   */
+  EndpointStats stats(void) const override;
 
-  //! Wait for communication line to be closed.
+  //! Wait for communication line to be closed and every message to be
+  //! handled.
   /*!
     \return Whether or not the wait was successful.
    */
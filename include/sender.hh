@@ -1,54 +1,476 @@
 #ifndef SENDER_HH_
 #define SENDER_HH_
+#include "codec.hh"
+#include "eventcount.hh"
+#include "frame.hh"
+#include "metrics.hh"
+#include "mpmcqueue.hh"
+#include "reactor.hh"
+#include "shmring.hh"
+#include "tuning.hh"
+#include "typetag.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <filesystem>
-#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <type_traits>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace cppiper {
 
+//! Policy applied when a message is queued on a full outbound queue.
+enum class OverflowPolicy {
+  //! Block the caller until space is available.
+  BLOCK,
+  //! Reject the new message.
+  FAIL,
+  //! Discard the oldest queued message to make room for the new one.
+  DROP_OLDEST,
+};
+
+//! Largest payload a cppiper::SenderOptions::shared_fifo sender can send.
+const size_t SHARED_FIFO_MAX_PAYLOAD = PIPE_BUF - FRAME_MAX_HEADER_SIZE;
+
+//! A callable completing a cppiper::Sender::send_async() call with a
+//! callback.
+/*!
+  Invoked with whether or not the message was written before its deadline.
+ */
+using SendCallback = std::function<void(bool sent)>;
+
+//! Options for constructing a sender.
+struct SenderOptions {
+  //! Maximum number of messages held in the outbound queue.
+  size_t queue_capacity = 1024;
+  //! Policy applied when the outbound queue is full.
+  OverflowPolicy overflow_policy = OverflowPolicy::BLOCK;
+  //! Wire format used to frame messages (cppiper::WireFormat::HEX for peers
+  //! predating wire format v2).
+  WireFormat wire_format = WireFormat::BINARY;
+  //! Attach a CRC32C checksum to binary frames.
+  bool checksum = false;
+  //! Compress binary frame payloads (receivers must understand
+  //! cppiper::FLAG_COMPRESSED).
+  bool compression = false;
+  //! Payloads smaller than this many bytes are never compressed.
+  size_t compression_threshold = 4096;
+  //! Reactor driving the sender (nullptr for a dedicated sender thread).
+  //! Ignored by the shared memory transport, which always uses a sender
+  //! thread.
+  Reactor *reactor = nullptr;
+  //! Transport carrying message bytes (must match the receiver's).
+  Transport transport = Transport::FIFO;
+  //! Capacity of a shared memory ring created by the sender.
+  size_t ring_capacity = SHM_RING_CAPACITY;
+  //! Payloads of at least this many bytes are spliced into the pipe with
+  //! vmsplice instead of being copied (0 to always copy; FIFO transport only).
+  size_t splice_threshold = 1 << 20;
+  //! Kernel buffer size requested for the pipe (0 keeps the kernel default).
+  size_t pipe_capacity = 0;
+  //! Maximum number of bytes gathered into a single write (0 to adapt it to
+  //! the observed message sizes).
+  size_t chunk_size = 0;
+  //! Share the pipe with other writers, such as senders in other processes.
+  //! Every write then holds whole frames and at most PIPE_BUF bytes, which
+  //! the kernel writes atomically, so frames of different writers never
+  //! interleave. Payloads are limited to cppiper::SHARED_FIFO_MAX_PAYLOAD
+  //! bytes and files cannot be sent (FIFO transport only).
+  bool shared_fifo = false;
+  //! Time to wait for a receiver to open the pipe before failing with
+  //! ETIMEDOUT (0 to wait indefinitely).
+  std::chrono::milliseconds connect_timeout = std::chrono::milliseconds(0);
+  //! Return from the constructor straight away and open the pipe in the
+  //! background (see cppiper::Sender::connected()). Messages sent meanwhile
+  //! are queued until the pipe opens.
+  bool async_connect = false;
+  //! How the sender thread waits for messages and pipe space, and how
+  //! callers wait for their sends. Strategies other than
+  //! cppiper::WaitStrategy::PARK make the sender thread's pipe non-blocking.
+  WaitStrategy wait_strategy = WaitStrategy::PARK;
+  //! Time spent spinning before parking with
+  //! cppiper::WaitStrategy::SPIN_THEN_PARK.
+  std::chrono::nanoseconds spin_budget = SPIN_BUDGET_DEFAULT;
+  //! Placement and scheduling of the sender thread (thread mode only).
+  ThreadOptions thread_options;
+};
+
 //! A class responsible for sending messages.
-class Sender {
+/*!
+  Any number of threads may send concurrently. Frames are queued on a
+  lock-free queue and written whole by a single sender thread (or reactor
+  loop), so they never interleave on the pipe.
+ */
+class Sender : private ReactorHandler, private MetricsSource {
 private:
+  //! Completion state of a message sent with a callback.
+  struct AsyncSend {
+    //! Callback completing the send.
+    SendCallback callback;
+    //! Flag used to signal the send has completed or its deadline passed.
+    std::atomic<bool> done{false};
+    //! Timer enforcing the deadline (never scheduled without one).
+    ReactorTimer timer;
+  };
+
+  //! A message owned by the outbound queue.
+  struct Frame {
+    //! Construct an empty frame (a slot to move a queued frame into).
+    Frame(void) : Frame(std::string(), std::nullopt) {}
+    //! Construct a frame.
+    Frame(std::string msg, std::optional<std::promise<bool>> promise,
+          uint64_t correlation_id = 0)
+        : header{}, header_size(0), msg(std::move(msg)), borrowed(nullptr),
+          borrowed_size(0), type_tag(0), correlation_id(correlation_id),
+          file_fd(-1), file_offset(0), file_length(0),
+          promise(std::move(promise)) {}
+    //! Construct a frame over a payload owned by a blocked caller, who must
+    //! keep it alive until the promise is resolved.
+    Frame(const char *data, size_t size, uint64_t type_tag,
+          std::promise<bool> promise)
+        : header{}, header_size(0), msg(), borrowed(data),
+          borrowed_size(size), type_tag(type_tag), correlation_id(0),
+          file_fd(-1), file_offset(0), file_length(0),
+          promise(std::move(promise)) {}
+    //! Construct a frame spliced from a file descriptor (the frame takes
+    //! ownership of the descriptor).
+    Frame(int file_fd, off_t file_offset, size_t file_length,
+          std::optional<std::promise<bool>> promise)
+        : header{}, header_size(0), msg(), borrowed(nullptr),
+          borrowed_size(0), type_tag(0), correlation_id(0), file_fd(file_fd),
+          file_offset(file_offset), file_length(file_length),
+          promise(std::move(promise)) {}
+    //! Move a frame.
+    Frame(Frame &&other) noexcept
+        : header_size(other.header_size), msg(std::move(other.msg)),
+          borrowed(other.borrowed), borrowed_size(other.borrowed_size),
+          type_tag(other.type_tag), correlation_id(other.correlation_id),
+          file_fd(std::exchange(other.file_fd, -1)),
+          file_offset(other.file_offset), file_length(other.file_length),
+          promise(std::move(other.promise)), async(std::move(other.async)) {
+      std::copy(other.header, other.header + other.header_size, header);
+    }
+    //! Move assign a frame, closing the file descriptor of a file frame.
+    Frame &operator=(Frame &&other) noexcept {
+      if (this != &other) {
+        if (file_fd != -1)
+          close(file_fd);
+        header_size = other.header_size;
+        std::copy(other.header, other.header + other.header_size, header);
+        msg = std::move(other.msg);
+        borrowed = other.borrowed;
+        borrowed_size = other.borrowed_size;
+        type_tag = other.type_tag;
+        correlation_id = other.correlation_id;
+        file_fd = std::exchange(other.file_fd, -1);
+        file_offset = other.file_offset;
+        file_length = other.file_length;
+        promise = std::move(other.promise);
+        async = std::move(other.async);
+      }
+      return *this;
+    }
+    //! Close the file descriptor of a file frame.
+    ~Frame(void) {
+      if (file_fd != -1)
+        close(file_fd);
+    }
+    //! Get the in-memory payload.
+    const char *payload(void) const { return borrowed ? borrowed : msg.data(); }
+    //! Get the payload length.
+    size_t length(void) const {
+      return file_fd != -1 ? file_length
+                           : borrowed ? borrowed_size : msg.size();
+    }
+    //! Encoded frame header and extension words.
+    char header[FRAME_MAX_HEADER_SIZE];
+    //! Encoded frame header size (0 if the frame could not be encoded).
+    size_t header_size;
+    //! Message payload owned by the frame.
+    std::string msg;
+    //! Payload owned by the caller (nullptr if the frame owns its payload).
+    const char *borrowed;
+    //! Length of a payload owned by the caller.
+    size_t borrowed_size;
+    //! Type tag of a typed message (0 for untyped messages).
+    uint64_t type_tag;
+    //! Correlation identifier (0 for uncorrelated messages).
+    uint64_t correlation_id;
+    //! Descriptor the payload is spliced from (-1 for in-memory payloads).
+    int file_fd;
+    //! Offset of the next payload byte in the file.
+    off_t file_offset;
+    //! Payload length of a file frame.
+    size_t file_length;
+    //! Completion promise (absent for fire-and-forget sends).
+    std::optional<std::promise<bool>> promise;
+    //! Completion callback state (sends with a callback only).
+    std::shared_ptr<AsyncSend> async;
+  };
+
+  //! A spliced payload kept alive until the receiver has read it.
+  struct Retired {
+    //! Payload whose pages are referenced by the pipe.
+    std::string msg;
+    //! Total pipe byte count once the payload has been read.
+    uint64_t end;
+  };
+
   //! Identifying name of this sender instance (for debugging).
   const std::string name;
   //! Path to the sender pipe.
   const std::filesystem::path pipepath;
-  //! Message buffer.
-  const std::string *buffer;
-  //! How much to write
-  const int buffering_limit;
+  //! Construction options.
+  const SenderOptions options;
+  //! Sizes the batches gathered into a single write.
+  ChunkSizer chunk_sizer;
+  //! Reactor driving the sender (nullptr in thread mode).
+  Reactor *const reactor;
+  //! Index of the reactor loop the pipe is attached to.
+  int loop;
   //! Code representing current status of sender thread.
-  int statuscode;
+  std::atomic<int> statuscode;
   //! Sender pipe file descriptor
   int pipe_fd;
-  //! Flag used to signal message is ready to be sent.
-  bool msg_ready;
-  //! Flag used to stop thread.
-  bool stop;
-  //! Lock utilised by conditional.
-  std::mutex lock;
-  //! Conditional used to synchronise with the thread.
-  std::condition_variable msg_conditional;
-  //! Sender thread.
+  //! Flag used to signal the pipe is open (and attached in reactor mode).
+  std::atomic<bool> pipe_open;
+  //! Promise resolved once the pipe opens or fails to.
+  std::promise<bool> connect_promise;
+  //! Future of the connect promise.
+  std::shared_future<bool> connect_future;
+  //! Shared memory ring (cppiper::Transport::SHARED_MEMORY only).
+  std::unique_ptr<ShmRing> ring;
+  //! Flag used to stop the sender (set until the sender starts connecting).
+  std::atomic<bool> stop;
+  //! Number of callers inside enqueue().
+  std::atomic<size_t> producers;
+  //! Outbound message queue, filled by any number of callers and drained by
+  //! the sender thread or reactor loop.
+  MPMCQueue<Frame> queue;
+  //! Number of frames queued or about to be (bounds the queue).
+  std::atomic<size_t> queued;
+  //! Number of frames ever queued.
+  std::atomic<uint64_t> enqueued_count;
+  //! Number of queued frames written, failed or dropped.
+  std::atomic<uint64_t> resolved_count;
+  //! Event the sender thread parks on while the queue is empty.
+  EventCount msg_event;
+  //! Event callers park on while the queue is full or they flush.
+  EventCount space_event;
+  //! Frame taken off the queue that did not fit in the previous batch.
+  std::optional<Frame> carried;
+  //! Frames taken off the queue for the current write.
+  std::vector<Frame> batch;
+  //! I/O vectors gathering the current batch.
+  std::vector<iovec> iov;
+  //! Frame each I/O vector is spliced from (nullptr for copied vectors).
+  std::vector<Frame *> iov_frames;
+  //! Index of the first I/O vector of the current batch not yet written.
+  size_t iov_index;
+  //! Number of bytes of the current batch written.
+  size_t batch_written;
+  //! Total number of bytes written to the pipe.
+  uint64_t pipe_written;
+  //! Spliced payloads the receiver may not have read yet.
+  std::deque<Retired> retired;
+  //! Flag used to signal a reactor pump is scheduled.
+  std::atomic<bool> wake_pending;
+  //! Lock guarding the parked frames.
+  std::mutex parked_lock;
+  //! Frames sent with a callback waiting for room in a full queue.
+  std::deque<Frame> parked;
+  //! Number of parked frames (read without the lock).
+  std::atomic<size_t> parked_count;
+  //! Runtime counters.
+  EndpointCounters counters;
+  //! Compression counters.
+  CompressionStats compression_stats;
+  //! Lock guarding the compression counters.
+  mutable std::mutex stats_lock;
+  //! Sender thread (or connecting thread with
+  //! cppiper::SenderOptions::async_connect).
   std::thread thread;
 
   //! Sender thread run method.
   void run();
 
+  //! Open the pipe, waiting up to the connect timeout for a receiver, and
+  //! attach it to the reactor.
+  /*!
+    \return Whether or not the pipe was opened.
+   */
+  bool connect(void);
+
+  //! Connecting thread run method (cppiper::SenderOptions::async_connect).
+  void run_connect(void);
+
+  //! Record a failure to open the pipe.
+  /*!
+    \param code status code of the failure.
+   */
+  void abandon(int code);
+
+  //! Wait for tasks posted to the reactor loop by a sender that never
+  //! opened its pipe.
+  void abandon_loop(void);
+
+  //! Compress the payload of a frame if it is worth it.
+  /*!
+    \param frame a frame with an in-memory payload.
+    \param extensions assigned the uncompressed length on success.
+    \return Whether or not the payload was replaced by a compressed block.
+   */
+  bool compress_frame(Frame &frame, FrameExtensions &extensions);
+
+  //! Encode the header of a frame according to the sender options.
+  /*!
+    \param frame a frame to encode.
+    \return Whether or not the frame could be encoded.
+   */
+  bool encode_frame(Frame &frame);
+
+  //! Move a batch of frames off the queue.
+  void take_batch(void);
+
+  //! Encode the current batch and gather it into I/O vectors.
+  void prepare_batch(void);
+
+  //! Write the current batch to the pipe with as few writes as possible.
+  /*!
+    \return Whether the batch is finished (false if the pipe would block).
+   */
+  bool write_batch(void);
+
+  //! Wait for a non-blocking pipe to take more bytes (thread mode).
+  /*!
+    \param spinner spinner of the current wait.
+   */
+  void wait_writable(SpinWait &spinner);
+
+  //! Wait for a send to complete according to the wait strategy.
+  /*!
+    \param sent future of the send.
+    \return Whether or not the message was written.
+   */
+  bool wait_sent(std::future<bool> &sent);
+
+  //! Copy the current batch into the shared memory ring, waiting for space
+  //! as needed.
+  /*!
+    \return Whether the batch is finished (always true).
+   */
+  bool write_ring(void);
+
+  //! Wake the receiver if it is waiting on the pipe for ring data.
+  void wake_receiver(void);
+
+  //! Resolve the frames of the current batch and clear it.
+  void complete_batch(void);
+
+  //! Free retired payloads the receiver has read.
+  void reclaim_retired(void);
+
+  //! Wait for the receiver to read every retired payload, or to go away.
+  void drain_retired(void);
+
+  //! Write queued batches until the queue is empty or the pipe would block
+  //! (reactor mode).
+  void pump(void);
+
+  //! Handle pipe writability (reactor mode).
+  /*!
+    \param events epoll event mask.
+   */
+  void handle_events(uint32_t events) override;
+
+  //! Resolve a frame dropped from the queue.
+  /*!
+    \param frame a frame taken off the queue.
+   */
+  void drop(Frame &frame);
+
+  //! Complete a send made with a callback, unless its deadline passed.
+  /*!
+    The callback is posted to the reactor loop rather than invoked in place
+    (invoked in place in thread mode).
+    \param async completion state of the send.
+    \param sent whether or not the message was written.
+   */
+  void complete_async(const std::shared_ptr<AsyncSend> &async, bool sent);
+
+  //! Reserve room for a frame if the queue is not full.
+  /*!
+    \return Whether or not room was reserved.
+   */
+  bool try_reserve(void);
+
+  //! Queue parked frames while the queue has room.
+  void admit_parked(void);
+
+  //! Fail every parked frame.
+  void fail_parked(void);
+
+  //! Push a frame on the queue once room is reserved and wake the sender.
+  /*!
+    \param frame a frame, moved from.
+   */
+  void push(Frame &frame);
+
+  //! Reserve room for a frame according to the overflow policy.
+  /*!
+    \param may_block whether the caller may block on a full queue.
+    \return Whether or not room was reserved.
+   */
+  bool reserve(bool may_block);
+
+  //! Queue a frame according to the overflow policy.
+  /*!
+    Lock-free unless the caller blocks on a full queue.
+    \param frame a frame to queue.
+    \param may_block whether the caller may block on a full queue.
+    \return Whether or not the frame was queued.
+   */
+  bool enqueue(Frame &&frame, bool may_block);
+
+  //! Send a payload in place, blocking until it has been written.
+  /*!
+    \param data payload bytes (must stay valid until the call returns).
+    \param size payload length.
+    \param type_tag type tag of a typed message (0 for untyped messages).
+    \return Whether or not the send was successful.
+   */
+  bool send_view(const char *data, size_t size, uint64_t type_tag);
+
 public:
   //! Deleted.
   Sender(void) = delete;
 
   //! Construct a sender.
   /*!
+    Blocks until a receiver opens the pipe, unless
+    cppiper::SenderOptions::async_connect is set.
     \param name identifying name of this sender instance (for debugging).
     \param pipepath path to the sender pipe.
+    \param options sender options.
    */
-  Sender(const std::string name, const std::filesystem::path pipepath);
+  Sender(const std::string name, const std::filesystem::path pipepath,
+         const SenderOptions &options = SenderOptions());
+
+  //! Unregister the sender from the cppiper::MetricsRegistry.
+  ~Sender(void);
 
   //! Get the sender thread's current status code.
   /*!
@@ -56,14 +478,200 @@ public:
    */
   int get_status_code(void) const;
 
-  //! Send a message over the pipe.
+  //! Get the outcome of opening the pipe.
+  /*!
+    \return A future resolving to whether or not the pipe was opened (false
+    once the connect timeout passed).
+   */
+  std::shared_future<bool> connected(void) const;
+
+  //! Send a message over the pipe, blocking until it has been written.
   /*!
     \param msg a message to send.
     \return Whether or not the send was successful.
    */
   bool send(const std::string &msg);
 
-  //! Terminate the pipe connection.
+  //! Send a message over the pipe, blocking until it has been written.
+  /*!
+    The bytes are written from the caller's buffer without an intermediate
+    copy.
+    \param msg a message to send.
+    \return Whether or not the send was successful.
+   */
+  bool send(std::string_view msg);
+
+  //! Send a null terminated message over the pipe, blocking until it has
+  //! been written.
+  /*!
+    \param msg a message to send (without its terminator).
+    \return Whether or not the send was successful.
+   */
+  bool send(const char *msg);
+
+  //! Send a message over the pipe, blocking until it has been written or
+  //! the timeout passes.
+  /*!
+    \param msg a message to send.
+    \param timeout time to wait for the message to be written.
+    \return Whether or not the message was written in time (see the deadline
+    overload: false does not mean the message was not delivered).
+   */
+  bool send(std::string msg, std::chrono::nanoseconds timeout);
+
+  //! Send a message over the pipe, blocking until it has been written or
+  //! the deadline passes.
+  /*!
+    With cppiper::OverflowPolicy::BLOCK the deadline also bounds the wait for
+    room in a full queue. A message still queued at the deadline is
+    discarded, but one the sender has already started writing is not, and
+    may still be delivered after this returns false. Callers retrying on
+    false can therefore deliver a message twice.
+    \param msg a message to send.
+    \param deadline time to give up at.
+    \return Whether or not the message was confirmed written in time (false
+    does not mean the message was not delivered).
+   */
+  bool send(std::string msg, std::chrono::steady_clock::time_point deadline);
+
+  //! Send a contiguous range of bytes over the pipe, blocking until it has
+  //! been written.
+  /*!
+    The bytes are written from the caller's buffer without an intermediate
+    copy.
+    \param data first byte to send.
+    \param size number of bytes to send.
+    \return Whether or not the send was successful.
+   */
+  bool send(const void *data, size_t size);
+
+  //! Send the bytes of a trivially copyable object, blocking until they have
+  //! been written.
+  /*!
+    The frame carries the cppiper::TypeTag of T so that receivers reject it
+    unless they ask for a T (see cppiper::Receiver::receive() and
+    cppiper::Message::as()). Requires the binary wire format.
+    \param object an object to send.
+    \return Whether or not the send was successful.
+   */
+  template <typename T,
+            typename = std::enable_if_t<std::is_class_v<T> or
+                                        std::is_union_v<T> or
+                                        std::is_arithmetic_v<T> or
+                                        std::is_enum_v<T>>>
+  bool send(const T &object) {
+    check_wire_type<T>();
+    return send_view(reinterpret_cast<const char *>(&object), sizeof(T),
+                     TypeTag<T>::value);
+  }
+
+  //! Queue a message for sending without waiting for it to be written.
+  /*!
+    Blocks only if the outbound queue is full and the overflow policy is
+    cppiper::OverflowPolicy::BLOCK.
+    \param msg a message to send.
+    \param correlation_id correlation identifier carried by the frame (0 for
+    none; requires the binary wire format, see cppiper::Channel).
+    \return A future resolving to whether or not the message was written.
+   */
+  std::future<bool> send_async(std::string msg, uint64_t correlation_id = 0);
+
+  //! Queue a message for sending without blocking the calling thread.
+  /*!
+    The callback runs on the sender's reactor loop once the message is
+    written, or once the deadline passes. A sender without a reactor runs it
+    on the sender thread, and cannot enforce a deadline. With
+    cppiper::OverflowPolicy::BLOCK a full queue parks the message, rather
+    than the caller, until there is room. A message whose deadline passes
+    before it is taken off the queue is discarded; one already being written
+    may still be.
+    \param msg a message to send.
+    \param callback invoked exactly once with whether or not the message was
+    written.
+    \param deadline time to give up at (time_point::max() for none; requires
+    a sender driven by a cppiper::Reactor otherwise).
+    \param correlation_id correlation identifier carried by the frame (0 for
+    none; requires the binary wire format, see cppiper::Channel).
+   */
+  void send_async(std::string msg, SendCallback callback,
+                  std::chrono::steady_clock::time_point deadline =
+                      std::chrono::steady_clock::time_point::max(),
+                  uint64_t correlation_id = 0);
+
+  //! Send a range of a file over the pipe, blocking until it has been
+  //! written.
+  /*!
+    The file contents are spliced into the pipe without passing through user
+    space, so they must not change until the receiver has read them. File
+    frames are never checksummed. Not supported by the shared memory
+    transport.
+    \param fd a descriptor open for reading (duplicated, the caller keeps
+    ownership).
+    \param offset offset of the first byte to send.
+    \param length number of bytes to send.
+    \return Whether or not the send was successful.
+   */
+  bool send_file(int fd, off_t offset, size_t length);
+
+  //! Queue a message for sending if this can be done without blocking.
+  /*!
+    A full queue fails the call unless the overflow policy is
+    cppiper::OverflowPolicy::DROP_OLDEST.
+    \param msg a message to send.
+    \return Whether or not the message was queued.
+   */
+  bool try_send(std::string msg);
+
+  //! Block until every queued message has been written.
+  /*!
+    \return Whether or not the sender is still running.
+   */
+  bool flush(void);
+
+  //! Get the number of messages waiting in the outbound queue.
+  /*!
+    \return Outbound queue size.
+   */
+  size_t queue_size(void);
+
+  //! Get the number of messages written to the pipe.
+  /*!
+    \return Message count.
+   */
+  uint64_t get_msg_count(void) const;
+
+  //! Get the kernel buffer size of the pipe.
+  /*!
+    \return Pipe capacity in bytes (0 if the pipe is not open).
+   */
+  size_t get_pipe_capacity(void) const;
+
+  //! Get the maximum number of bytes currently gathered into a single write.
+  /*!
+    \return Chunk size in bytes.
+   */
+  size_t get_chunk_size(void) const;
+
+  //! Get the compression counters.
+  /*!
+    \return Counters of the frames compressed so far.
+   */
+  CompressionStats get_compression_stats(void) const;
+
+  //! Get the number of write system calls issued on the pipe.
+  /*!
+    \return Write system call count.
+   */
+  uint64_t get_write_count(void) const;
+
+  //! Take a snapshot of the runtime counters.
+  /*!
+    Lock-free, so it may be called from any thread at any rate.
+    \return Counter snapshot.
+   */
+  EndpointStats stats(void) const override;
+
+  //! Terminate the pipe connection once queued messages have been written.
   /*!
    \return Whether or not the termination was successful.
    */
@@ -0,0 +1,177 @@
+#ifndef SHMRING_HH_
+#define SHMRING_HH_
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace cppiper {
+
+//! Transport carrying message bytes between a sender and a receiver.
+enum class Transport {
+  //! Message bytes are written through the named pipe.
+  FIFO,
+  //! Message bytes are copied through a shared memory ring, the named pipe
+  //! only carries wakeups and end of stream.
+  SHARED_MEMORY,
+};
+
+//! Default shared memory ring capacity in bytes.
+const size_t SHM_RING_CAPACITY = 1 << 22;
+
+//! A single producer, single consumer byte ring in POSIX shared memory.
+/*!
+  The segment backing a pipe is named after the absolute pipe path (see
+  segment_name()). The sender creates and resets it before opening its end of
+  the pipe, so the receiver can map it as soon as its own open returns.
+ */
+class ShmRing {
+private:
+  struct Header;
+
+  //! Shared memory file descriptor.
+  int fd;
+  //! Size of the mapping.
+  size_t map_size;
+  //! Mapped segment.
+  void *map;
+  //! Control block at the start of the segment.
+  Header *header;
+  //! Ring storage following the control block.
+  char *data;
+  //! Ring storage capacity (a power of two).
+  uint64_t capacity;
+  //! Last consumer position seen by the producer.
+  uint64_t cached_head;
+  //! Last producer position seen by the consumer.
+  uint64_t cached_tail;
+
+  //! Open and map the segment backing a pipe.
+  /*!
+    \param pipepath path to the pipe.
+    \param capacity ring capacity to size a new segment with (0 to require an
+    existing segment).
+    \return Whether or not the segment was mapped.
+   */
+  bool map_segment(const std::filesystem::path &pipepath, size_t capacity);
+
+  //! Unmap the segment.
+  void unmap(void);
+
+public:
+  //! Construct an unmapped ring.
+  ShmRing(void);
+
+  //! Deleted.
+  ShmRing(const ShmRing &) = delete;
+
+  //! Deleted.
+  ShmRing &operator=(const ShmRing &) = delete;
+
+  //! Unmap the ring.
+  ~ShmRing(void);
+
+  //! Get the name of the shared memory segment backing a pipe.
+  /*!
+    \param pipepath path to the pipe.
+    \return Segment name suitable for shm_open().
+   */
+  static std::string segment_name(const std::filesystem::path &pipepath);
+
+  //! Create the shared memory segment backing a pipe if it does not exist.
+  /*!
+    \param pipepath path to the pipe.
+    \param capacity ring capacity in bytes (rounded up to a power of two).
+    \return Whether or not the segment exists.
+   */
+  static bool create_segment(const std::filesystem::path &pipepath,
+                             size_t capacity = SHM_RING_CAPACITY);
+
+  //! Remove the shared memory segment backing a pipe.
+  /*!
+    \param pipepath path to the pipe.
+    \return Whether or not a segment was removed.
+   */
+  static bool remove_segment(const std::filesystem::path &pipepath);
+
+  //! Map the segment backing a pipe as its producer, creating it if needed
+  //! and resetting the ring.
+  /*!
+    \param pipepath path to the pipe.
+    \param capacity ring capacity to size a new segment with.
+    \return Whether or not the ring is ready.
+   */
+  bool create(const std::filesystem::path &pipepath, size_t capacity);
+
+  //! Map the segment backing a pipe as its consumer.
+  /*!
+    \param pipepath path to the pipe.
+    \return Whether or not the ring is ready.
+   */
+  bool open(const std::filesystem::path &pipepath);
+
+  //! Get the ring capacity.
+  /*!
+    \return Ring capacity in bytes.
+   */
+  size_t get_capacity(void) const;
+
+  //! Copy bytes into the ring without blocking (producer only).
+  /*!
+    \param src bytes to copy.
+    \param len number of bytes to copy.
+    \return Number of bytes copied (0 if the ring is full).
+   */
+  size_t write(const void *src, size_t len);
+
+  //! Copy bytes out of the ring without blocking (consumer only).
+  /*!
+    \param dst buffer to copy into.
+    \param len buffer size.
+    \return Number of bytes copied (0 if the ring is empty).
+   */
+  size_t read(void *dst, size_t len);
+
+  //! Get the number of bytes the producer can write.
+  /*!
+    \return Free bytes.
+   */
+  size_t writable(void);
+
+  //! Announce the consumer is about to wait for a wakeup on the pipe.
+  /*!
+    The consumer must re-check the ring before waiting.
+   */
+  void prepare_read_wait(void);
+
+  //! Check whether the consumer asked for a wakeup, clearing the request.
+  /*!
+    \return Whether or not the producer must wake the consumer.
+   */
+  bool take_read_wait(void);
+
+  //! Announce the producer is about to wait for space.
+  /*!
+    \return Key to pass to commit_space_wait().
+   */
+  uint32_t prepare_space_wait(void);
+
+  //! Withdraw an intent to wait for space.
+  void cancel_space_wait(void);
+
+  //! Park the producer until space is freed or a timeout elapses.
+  /*!
+    \param key key returned by prepare_space_wait().
+    \param timeout maximum time to park for.
+    \return Whether or not the wait ended before the timeout elapsed.
+   */
+  bool commit_space_wait(uint32_t key, std::chrono::nanoseconds timeout);
+
+  //! Wake the producer if it is waiting for space.
+  void notify_space(void);
+};
+
+} // namespace cppiper
+
+#endif // SHMRING_HH_
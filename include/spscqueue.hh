@@ -0,0 +1,132 @@
+#ifndef SPSCQUEUE_HH_
+#define SPSCQUEUE_HH_
+#include "eventcount.hh"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cppiper {
+
+//! Round a capacity up to the next power of two.
+/*!
+  \param capacity a capacity.
+  \return The smallest power of two no less than the capacity (at least 2).
+ */
+inline size_t ring_capacity(size_t capacity) {
+  size_t rounded(2);
+  while (rounded < capacity)
+    rounded <<= 1;
+  return rounded;
+}
+
+//! A bounded lock-free single-producer single-consumer queue.
+/*!
+  The producer and consumer indices live on separate cache lines, and each side
+  caches the other's index so that the shared line is only touched when the
+  queue looks full or empty.
+ */
+template <typename T> class SPSCQueue {
+private:
+  //! Uninitialised storage for a queued element.
+  using Slot = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+  //! Slot count (a power of two).
+  const size_t capacity;
+  //! Mask mapping an index onto a slot.
+  const size_t mask;
+  //! Element storage.
+  const std::unique_ptr<Slot[]> slots;
+  //! Next index to pop (owned by the consumer).
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+  //! Consumer's cached copy of the tail index.
+  size_t cached_tail;
+  //! Next index to push (owned by the producer).
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+  //! Producer's cached copy of the head index.
+  size_t cached_head;
+
+  //! Get the element at an index.
+  T *slot(size_t index) {
+    return std::launder(reinterpret_cast<T *>(&slots[index & mask]));
+  }
+
+public:
+  //! Construct a queue.
+  /*!
+    \param capacity minimum number of elements the queue can hold.
+   */
+  explicit SPSCQueue(size_t capacity)
+      : capacity(ring_capacity(capacity)), mask(this->capacity - 1),
+        slots(new Slot[this->capacity]), head(0), cached_tail(0), tail(0),
+        cached_head(0) {}
+
+  //! Deleted.
+  SPSCQueue(const SPSCQueue &) = delete;
+
+  //! Deleted.
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  //! Destroy any elements left in the queue.
+  ~SPSCQueue(void) {
+    for (size_t index = head.load(); index != tail.load(); index++)
+      slot(index)->~T();
+  }
+
+  //! Push an element (producer only).
+  /*!
+    \param value an element, moved from only on success.
+    \return Whether or not there was room for the element.
+   */
+  bool try_push(T &value) {
+    const size_t index(tail.load(std::memory_order_relaxed));
+    if (index - cached_head == capacity) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (index - cached_head == capacity)
+        return false;
+    }
+    new (&slots[index & mask]) T(std::move(value));
+    tail.store(index + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! Pop an element (consumer only).
+  /*!
+    \param value assigned the popped element.
+    \return Whether or not an element was available.
+   */
+  bool try_pop(T &value) {
+    const size_t index(head.load(std::memory_order_relaxed));
+    if (index == cached_tail) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (index == cached_tail)
+        return false;
+    }
+    T *element(slot(index));
+    value = std::move(*element);
+    element->~T();
+    head.store(index + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! Get the approximate number of queued elements.
+  /*!
+    \return Queue size.
+   */
+  size_t size(void) const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+
+  //! Get the queue capacity.
+  /*!
+    \return Maximum number of elements.
+   */
+  size_t get_capacity(void) const { return capacity; }
+};
+
+} // namespace cppiper
+
+#endif // SPSCQUEUE_HH_
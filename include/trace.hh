@@ -0,0 +1,102 @@
+#ifndef TRACE_HH_
+#define TRACE_HH_
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace cppiper {
+
+//! Default number of records held by the trace ring.
+const size_t TRACE_RING_CAPACITY = 1 << 16;
+
+//! Events recorded in the trace ring.
+enum class TraceEvent : uint16_t {
+  //! A message was queued on a sender (value: payload bytes).
+  SEND_QUEUED,
+  //! A sender started writing a batch (value: number of frames).
+  BATCH_STARTED,
+  //! A sender finished writing a frame (value: frame bytes).
+  FRAME_SENT,
+  //! A caller blocked on a full outbound queue (value: queue depth).
+  SEND_BLOCKED,
+  //! A receiver read from its transport (value: bytes read).
+  READ,
+  //! A receiver decoded a frame (value: payload bytes).
+  FRAME_RECEIVED,
+  //! A consumer took a message off a receive queue (value: payload bytes).
+  MESSAGE_TAKEN,
+  //! A receiver stopped reading on a full queue (value: queue depth).
+  RECEIVE_PAUSED,
+  //! A receiver resumed reading (value: queue depth).
+  RECEIVE_RESUMED,
+};
+
+//! Get the name of a trace event.
+/*!
+  \param event a trace event.
+  \return The event name.
+ */
+const char *trace_event_name(TraceEvent event);
+
+//! A trace ring record.
+struct TraceRecord {
+  //! Monotonic clock time of the event in nanoseconds.
+  uint64_t timestamp;
+  //! Event specific value.
+  uint64_t value;
+  //! Identifier of the endpoint (see cppiper::EndpointStats::id).
+  uint32_t endpoint;
+  //! Event type.
+  TraceEvent event;
+};
+
+//! Process-wide ring of timestamped binary endpoint events.
+/*!
+  Recording an event costs a clock read and a few relaxed atomic stores, so
+  the ring can stay enabled under load to diagnose latency spikes and be
+  dumped once one has been seen. The oldest records are overwritten once the
+  ring is full. Events are only recorded by libraries built with the TRACE
+  CMake option, and only while the ring is enabled.
+ */
+class TraceRing {
+public:
+  //! Deleted.
+  TraceRing(void) = delete;
+
+  //! Start recording events.
+  /*!
+    \param capacity number of records to hold (rounded up to a power of two;
+    only the first call allocates the ring, later calls reuse it).
+    \return Whether or not the library was built with tracing.
+   */
+  static bool enable(size_t capacity = TRACE_RING_CAPACITY);
+
+  //! Stop recording events, keeping the records held so far.
+  static void disable(void);
+
+  //! Record an event if the ring is enabled.
+  /*!
+    \param event event type.
+    \param endpoint identifier of the endpoint.
+    \param value event specific value.
+   */
+  static void record(TraceEvent event, uint32_t endpoint, uint64_t value);
+
+  //! Copy the records currently held, oldest first.
+  /*!
+    Records being overwritten while they are copied are skipped.
+    \return The records.
+   */
+  static std::vector<TraceRecord> dump(void);
+
+  //! Write the records currently held as text, one per line.
+  /*!
+    \param out stream to write to.
+   */
+  static void write(std::ostream &out);
+};
+
+} // namespace cppiper
+
+#endif // TRACE_HH_
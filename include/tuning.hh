@@ -0,0 +1,164 @@
+#ifndef TUNING_HH_
+#define TUNING_HH_
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace cppiper {
+
+//! Smallest adaptive I/O chunk size.
+const size_t CHUNK_SIZE_MIN = 1 << 12;
+
+//! Largest adaptive I/O chunk size.
+const size_t CHUNK_SIZE_MAX = 1 << 20;
+
+//! Initial adaptive I/O chunk size.
+const size_t CHUNK_SIZE_DEFAULT = 1 << 16;
+
+//! Adapts an I/O chunk size to the observed frame size distribution.
+/*!
+  The chunk size tracks a moving average of frame sizes, scaled so that a
+  chunk holds cppiper::ChunkSizer::FRAMES_PER_CHUNK average frames, rounded to
+  a power of two and clamped to [cppiper::CHUNK_SIZE_MIN, limit]. It grows as
+  soon as larger frames are seen and only shrinks once frames are
+  consistently a quarter of the size, so it does not flap between two sizes.
+  Only one thread may observe frames; any thread may read the chunk size.
+ */
+class ChunkSizer {
+private:
+  //! Number of average frames a chunk should hold.
+  static const size_t FRAMES_PER_CHUNK = 256;
+  //! Number of observations between chunk size updates.
+  static const size_t UPDATE_INTERVAL = 64;
+
+  //! Fixed chunk size (0 to adapt).
+  const size_t fixed;
+  //! Largest chunk size.
+  size_t limit;
+  //! Moving average of frame sizes (fixed point, 4 fractional bits).
+  uint64_t average;
+  //! Observations since the last update.
+  size_t observed;
+  //! Current chunk size.
+  std::atomic<size_t> chunk;
+
+public:
+  //! Construct a chunk sizer.
+  /*!
+    \param fixed a fixed chunk size (0 to adapt to observed frame sizes).
+   */
+  explicit ChunkSizer(size_t fixed);
+
+  //! Set the largest chunk size, clamping the current chunk size to it.
+  /*!
+    \param limit largest chunk size (ignored by fixed chunk sizes).
+   */
+  void set_limit(size_t limit);
+
+  //! Record the size of a frame.
+  /*!
+    \param frame_bytes frame size including its header.
+   */
+  void observe(size_t frame_bytes);
+
+  //! Get the current chunk size.
+  /*!
+    \return Chunk size in bytes.
+   */
+  size_t get(void) const;
+};
+
+//! Resize the kernel buffer of a pipe.
+/*!
+  Requests above /proc/sys/fs/pipe-max-size are clamped to it, and requests the
+  kernel refuses (e.g. over the per-user limit) leave the pipe unchanged.
+  \param fd a pipe file descriptor.
+  \param capacity requested capacity in bytes (0 to leave the pipe unchanged).
+  \param pipepath path to the pipe (for logging).
+  \return The actual capacity of the pipe, or 0 if it could not be queried.
+ */
+size_t tune_pipe_capacity(int fd, size_t capacity,
+                          const std::filesystem::path &pipepath);
+
+//! How a thread waits for its queue or pipe to become ready.
+enum class WaitStrategy {
+  //! Park in the kernel straight away.
+  PARK,
+  //! Spin for a budget, then park. Saves the scheduler wakeup when the wait
+  //! is short.
+  SPIN_THEN_PARK,
+  //! Never park. Spins on the queue, or retries reads and writes on a
+  //! non-blocking pipe, at the cost of a busy core.
+  BUSY_POLL,
+};
+
+//! Default spin budget of cppiper::WaitStrategy::SPIN_THEN_PARK.
+const std::chrono::nanoseconds SPIN_BUDGET_DEFAULT =
+    std::chrono::microseconds(50);
+
+//! Spins according to a cppiper::WaitStrategy before a thread parks.
+/*!
+  The budget starts with the first spin() of a wait and is restarted by
+  reset().
+ */
+class SpinWait {
+private:
+  //! Wait strategy.
+  const WaitStrategy strategy;
+  //! Time spent spinning before parking (SPIN_THEN_PARK only).
+  const std::chrono::nanoseconds budget;
+  //! Time to stop spinning at.
+  std::chrono::steady_clock::time_point deadline;
+  //! Flag used to signal the budget has started.
+  bool spinning;
+
+public:
+  //! Construct a spinner.
+  /*!
+    \param strategy wait strategy.
+    \param budget time spent spinning before parking (SPIN_THEN_PARK only).
+   */
+  SpinWait(WaitStrategy strategy, std::chrono::nanoseconds budget);
+
+  //! Spin once.
+  /*!
+    \return Whether or not to check the condition again instead of parking.
+   */
+  bool spin(void);
+
+  //! Restart the budget for the next wait.
+  void reset(void);
+};
+
+//! Placement and scheduling of an endpoint thread.
+struct ThreadOptions {
+  //! CPUs the thread may run on (empty to keep the inherited affinity).
+  std::vector<int> cpus;
+  //! Scheduling policy, such as SCHED_FIFO (-1 to keep the inherited
+  //! policy).
+  int policy = -1;
+  //! Priority within the scheduling policy (1 to 99 for SCHED_FIFO and
+  //! SCHED_RR, 0 otherwise).
+  int priority = 0;
+};
+
+//! Apply placement and scheduling options to a thread.
+/*!
+  Failures, such as a real-time policy without the privilege for it, are
+  logged and leave the thread as it was.
+  \param thread a thread.
+  \param options placement and scheduling options.
+  \param name name of the endpoint owning the thread (for logging).
+  \return Whether or not every option was applied.
+ */
+bool apply_thread_options(pthread_t thread, const ThreadOptions &options,
+                          const std::string &name);
+
+} // namespace cppiper
+
+#endif // TUNING_HH_
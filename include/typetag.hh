@@ -0,0 +1,64 @@
+#ifndef TYPETAG_HH_
+#define TYPETAG_HH_
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+namespace cppiper {
+
+//! Hash a string with 64-bit FNV-1a.
+/*!
+  \param str a null terminated string.
+  \return The hash.
+ */
+constexpr uint64_t fnv1a(const char *str) {
+  uint64_t hash(14695981039346656037ULL);
+  for (; *str; str++) {
+    hash ^= static_cast<unsigned char>(*str);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+//! Check that a type can be sent as raw object bytes.
+/*!
+  Fails to compile unless objects of the type are trivially copyable, do not
+  hold pointers that would be meaningless in another process, and can be
+  viewed in place in a received message buffer.
+ */
+template <typename T> constexpr void check_wire_type(void) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Typed messages must be trivially copyable");
+  static_assert(not std::is_pointer_v<T> and not std::is_member_pointer_v<T>,
+                "Typed messages must not be pointers");
+  static_assert(not std::is_empty_v<T>, "Typed messages must not be empty");
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                "Typed messages must not be over-aligned");
+}
+
+//! Type tag carried by typed messages of a type.
+/*!
+  The default tag hashes the compiler's name for the type together with its
+  size and alignment, so it is only stable between peers built with the same
+  compiler. Specialise this template with a fixed value to exchange a type
+  between differently built peers or across renames.
+ */
+template <typename T> struct TypeTag {
+private:
+  //! Hash the name of the type.
+  static constexpr uint64_t hash(void) {
+    uint64_t hash(fnv1a(__PRETTY_FUNCTION__));
+    hash = (hash ^ sizeof(T)) * 1099511628211ULL;
+    hash = (hash ^ alignof(T)) * 1099511628211ULL;
+    return hash == 0 ? 1 : hash;
+  }
+
+public:
+  //! Tag value (never 0, which marks untyped messages).
+  static constexpr uint64_t value = hash();
+};
+
+} // namespace cppiper
+
+#endif // TYPETAG_HH_
@@ -0,0 +1,64 @@
+#include "../include/bufferpool.hh"
+#include "cppiperconfig.hh"
+#include <algorithm>
+#include <mutex>
+
+//! Maximum number of free buffers kept per size class.
+static const size_t CLASS_MAX_BUFFERS = 1024;
+
+size_t cppiper::BufferPool::size_class(size_t size) {
+  size_t shift(BUFFER_MIN_SHIFT);
+  while (shift <= BUFFER_MAX_SHIFT and (size_t(1) << shift) < size)
+    shift++;
+  return shift - BUFFER_MIN_SHIFT;
+}
+
+cppiper::BufferPool::BufferPool(size_t class_limit)
+    : class_limit(class_limit), lock(), free_lists{} {}
+
+cppiper::Message cppiper::BufferPool::acquire(size_t size) {
+  if (size == 0)
+    return Message(shared_from_this(), nullptr, 0, 0);
+  const size_t index(size_class(size));
+  if (index == CLASS_COUNT)
+    return Message(shared_from_this(), std::unique_ptr<char[]>(new char[size]),
+                   size, size);
+  const size_t capacity(size_t(1) << (index + BUFFER_MIN_SHIFT));
+  {
+    std::lock_guard lk(lock);
+    auto &free_list = free_lists[index];
+    if (not free_list.empty()) {
+      std::unique_ptr<char[]> buffer(std::move(free_list.back()));
+      free_list.pop_back();
+      return Message(shared_from_this(), std::move(buffer), capacity, size);
+    }
+  }
+  return Message(shared_from_this(), std::unique_ptr<char[]>(new char[capacity]),
+                 capacity, size);
+}
+
+void cppiper::BufferPool::release(std::unique_ptr<char[]> buffer,
+                                  size_t capacity) {
+  if (not buffer)
+    return;
+  const size_t index(size_class(capacity));
+  if (index == CLASS_COUNT)
+    return;
+  const size_t max_buffers(
+      std::clamp(class_limit / capacity, size_t(1), CLASS_MAX_BUFFERS));
+  std::lock_guard lk(lock);
+  auto &free_list = free_lists[index];
+  if (free_list.size() >= max_buffers)
+    return;
+  if (free_list.capacity() == 0)
+    free_list.reserve(max_buffers);
+  free_list.emplace_back(std::move(buffer));
+}
+
+size_t cppiper::BufferPool::cached_bytes(void) {
+  std::lock_guard lk(lock);
+  size_t total(0);
+  for (size_t index = 0; index < CLASS_COUNT; index++)
+    total += free_lists[index].size() << (index + BUFFER_MIN_SHIFT);
+  return total;
+}
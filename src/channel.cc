@@ -0,0 +1,267 @@
+#include "../include/channel.hh"
+#include "cppiperconfig.hh"
+#include "logging.hh"
+#include <glog/logging.h>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+//! Get a future that is already resolved to an empty reply.
+/*!
+  \return The future.
+ */
+std::future<std::optional<cppiper::Message>> failed_call(void) {
+  std::promise<std::optional<cppiper::Message>> promise;
+  promise.set_value(std::nullopt);
+  return promise.get_future();
+}
+
+} // namespace
+
+cppiper::Channel::Channel(const std::string name,
+                          const std::filesystem::path request_pipe,
+                          const std::filesystem::path reply_pipe,
+                          ChannelRole role, const ChannelOptions &options)
+    : name(name), role(role), options(options), handler(), sender(),
+      receiver(), next_id(1), opened(false), lock(), open_conditional(),
+      timer_conditional(), calls(), deadlines(), closed(false), timeouts(0) {
+  open(request_pipe, reply_pipe);
+}
+
+cppiper::Channel::Channel(const std::string name,
+                          const std::filesystem::path request_pipe,
+                          const std::filesystem::path reply_pipe,
+                          RequestHandler handler,
+                          const ChannelOptions &options)
+    : name(name), role(ChannelRole::SERVER), options(options),
+      handler(std::move(handler)), sender(), receiver(), next_id(1),
+      opened(false), lock(), open_conditional(), timer_conditional(), calls(),
+      deadlines(), closed(false), timeouts(0) {
+  open(request_pipe, reply_pipe);
+}
+
+cppiper::Channel::~Channel(void) { close(); }
+
+void cppiper::Channel::open(const std::filesystem::path &request_pipe,
+                            const std::filesystem::path &reply_pipe) {
+  if (options.sender.wire_format != WireFormat::BINARY)
+    LOG(ERROR) << "Channel instance " << name
+               << " requires the binary wire format, requests will fail";
+  // The client opens the request pipe first and the server opens it last,
+  // so both ends open their pipes in the same order and never deadlock.
+  if (role == ChannelRole::CLIENT) {
+    DEBUG_LOG << "Opening client end of channel " << name << "...";
+    sender = std::make_unique<Sender>(name, request_pipe, options.sender);
+    receiver = std::make_unique<Receiver>(name, reply_pipe, options.receiver);
+    reply_thread = std::thread(&Channel::collect_replies, this);
+    timer_thread = std::thread(&Channel::expire_calls, this);
+  } else {
+    DEBUG_LOG << "Opening server end of channel " << name << "...";
+    if (handler)
+      receiver = std::make_unique<Receiver>(
+          name, request_pipe,
+          [this](const Message &request) { serve(request); },
+          options.receiver);
+    else
+      receiver =
+          std::make_unique<Receiver>(name, request_pipe, options.receiver);
+    sender = std::make_unique<Sender>(name, reply_pipe, options.sender);
+  }
+  {
+    std::lock_guard lk(lock);
+    opened = true;
+  }
+  open_conditional.notify_all();
+  LOG(INFO) << "Constructed channel instance " << name << " as "
+            << (role == ChannelRole::CLIENT ? "client" : "server");
+}
+
+void cppiper::Channel::serve(const Message &request) {
+  std::string response;
+  try {
+    response = handler(request);
+  } catch (const std::exception &e) {
+    LOG(ERROR) << "Request handler on channel instance " << name
+               << " threw: " << e.what();
+  } catch (...) {
+    LOG(ERROR) << "Request handler on channel instance " << name
+               << " threw a non-standard exception";
+  }
+  reply(request, std::move(response));
+}
+
+bool cppiper::Channel::complete(uint64_t id, std::optional<Message> reply) {
+  const auto call(calls.find(id));
+  if (call == calls.end())
+    return false;
+  deadlines.erase({call->second.deadline, id});
+  call->second.promise.set_value(std::move(reply));
+  calls.erase(call);
+  return true;
+}
+
+void cppiper::Channel::collect_replies(void) {
+  while (std::optional<Message> reply = receiver->receive(true)) {
+    const uint64_t id(reply->correlation_id());
+    std::lock_guard lk(lock);
+    if (not complete(id, std::move(reply)))
+      DEBUG_LOG << "Dropping reply " << id << " on channel instance " << name
+                << ", its call timed out or was never made";
+  }
+  DEBUG_LOG << "Reply pipe of channel instance " << name << " closed";
+  fail_calls();
+}
+
+void cppiper::Channel::expire_calls(void) {
+  std::unique_lock lk(lock);
+  while (not closed) {
+    if (deadlines.empty())
+      timer_conditional.wait(lk);
+    else {
+      // Copied, the set node may be erased while the timer waits.
+      const auto deadline(deadlines.begin()->first);
+      timer_conditional.wait_until(lk, deadline);
+    }
+    const auto now(std::chrono::steady_clock::now());
+    while (not deadlines.empty() and deadlines.begin()->first <= now) {
+      const uint64_t id(deadlines.begin()->second);
+      complete(id, std::nullopt);
+      timeouts++;
+      DEBUG_LOG << "Call " << id << " timed out on channel instance " << name;
+    }
+  }
+}
+
+void cppiper::Channel::fail_calls(void) {
+  std::lock_guard lk(lock);
+  if (not calls.empty())
+    LOG(WARNING) << "Failing " << calls.size()
+                 << " outstanding calls on channel instance " << name;
+  for (auto &call : calls)
+    call.second.promise.set_value(std::nullopt);
+  calls.clear();
+  deadlines.clear();
+}
+
+cppiper::ChannelRole cppiper::Channel::get_role(void) const { return role; }
+
+int cppiper::Channel::get_status_code(void) const {
+  const int statuscode(sender ? sender->get_status_code() : 0);
+  return statuscode != 0 or not receiver ? statuscode
+                                         : receiver->get_status_code();
+}
+
+std::future<std::optional<cppiper::Message>>
+cppiper::Channel::call(std::string request) {
+  return call(std::move(request), options.timeout);
+}
+
+std::future<std::optional<cppiper::Message>>
+cppiper::Channel::call(std::string request,
+                       std::chrono::milliseconds timeout) {
+  if (role != ChannelRole::CLIENT) {
+    LOG(ERROR) << "Attempt to call on server channel instance " << name;
+    return failed_call();
+  }
+  const uint64_t id(next_id.fetch_add(1, std::memory_order_relaxed));
+  std::promise<std::optional<Message>> promise;
+  std::future<std::optional<Message>> reply(promise.get_future());
+  {
+    std::lock_guard lk(lock);
+    if (closed) {
+      LOG(WARNING) << "Attempt to call on closed channel instance " << name;
+      return failed_call();
+    }
+    // Registered before sending, so even an immediate reply finds its call.
+    const auto deadline(timeout.count() > 0
+                            ? std::chrono::steady_clock::now() + timeout
+                            : std::chrono::steady_clock::time_point::max());
+    calls.emplace(id, Call{std::move(promise), deadline});
+    if (timeout.count() > 0) {
+      const auto expiry(deadlines.emplace(deadline, id).first);
+      if (expiry == deadlines.begin())
+        timer_conditional.notify_one();
+    }
+  }
+  TRACE_LOG << "Calling " << id << " on channel instance " << name;
+  // Completed from the sender, so a request that fails after queueing, or is
+  // dropped at terminate, does not leave its call waiting forever.
+  sender->send_async(
+      std::move(request),
+      [this, id](bool sent) {
+        if (sent)
+          return;
+        LOG(ERROR) << "Request " << id << " failed to send on channel instance "
+                   << name;
+        std::lock_guard lk(lock);
+        complete(id, std::nullopt);
+      },
+      std::chrono::steady_clock::time_point::max(), id);
+  return reply;
+}
+
+size_t cppiper::Channel::outstanding(void) {
+  std::lock_guard lk(lock);
+  return calls.size();
+}
+
+uint64_t cppiper::Channel::get_timeout_count(void) {
+  std::lock_guard lk(lock);
+  return timeouts;
+}
+
+std::optional<cppiper::Message> cppiper::Channel::receive(bool wait) {
+  if (role != ChannelRole::SERVER) {
+    LOG(ERROR) << "Attempt to receive requests on client channel instance "
+               << name;
+    return {};
+  }
+  return receiver->receive(wait);
+}
+
+std::future<bool> cppiper::Channel::reply(const Message &request,
+                                          std::string response) {
+  if (role != ChannelRole::SERVER) {
+    LOG(ERROR) << "Attempt to reply on client channel instance " << name;
+    std::promise<bool> rejected;
+    rejected.set_value(false);
+    return rejected.get_future();
+  }
+  // A handler can see its first request before the reply pipe has opened.
+  if (not opened) {
+    std::unique_lock lk(lock);
+    open_conditional.wait(lk, [this]() { return opened.load(); });
+  }
+  TRACE_LOG << "Replying to " << request.correlation_id()
+            << " on channel instance " << name;
+  return sender->send_async(std::move(response), request.correlation_id());
+}
+
+bool cppiper::Channel::close(void) {
+  {
+    std::lock_guard lk(lock);
+    if (closed or not opened)
+      return true;
+  }
+  DEBUG_LOG << "Closing channel instance " << name << "...";
+  bool closed_cleanly(true);
+  if (role == ChannelRole::CLIENT) {
+    closed_cleanly = sender->terminate() and closed_cleanly;
+    closed_cleanly = receiver->wait() and closed_cleanly;
+    reply_thread.join();
+  } else {
+    closed_cleanly = receiver->wait() and closed_cleanly;
+    closed_cleanly = sender->terminate() and closed_cleanly;
+  }
+  {
+    std::lock_guard lk(lock);
+    closed = true;
+  }
+  timer_conditional.notify_all();
+  if (timer_thread.joinable())
+    timer_thread.join();
+  fail_calls();
+  LOG(INFO) << "Closed channel instance " << name;
+  return closed_cleanly;
+}
@@ -0,0 +1,166 @@
+#include "../include/codec.hh"
+#include "cppiperconfig.hh"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+//! Shortest match the format can encode.
+const size_t MIN_MATCH = 4;
+
+//! The last bytes of a block are always literals.
+const size_t LAST_LITERALS = 5;
+
+//! No match may start within this many bytes of the end of a block.
+const size_t MATCH_FIND_LIMIT = 12;
+
+//! Largest match offset.
+const size_t MAX_OFFSET = 65535;
+
+//! Log2 of the number of match finder hash table entries.
+const int HASH_LOG = 14;
+
+//! Misses before the match finder starts skipping ahead.
+const int SKIP_TRIGGER = 6;
+
+uint32_t read32(const char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t hash32(uint32_t value) {
+  return (value * 2654435761U) >> (32 - HASH_LOG);
+}
+
+//! Write a length continuation (the part of a length above 14).
+char *write_length(char *op, size_t length) {
+  for (; length >= 255; length -= 255)
+    *op++ = static_cast<char>(255);
+  *op++ = static_cast<char>(length);
+  return op;
+}
+
+//! Read a length continuation.
+bool read_length(const unsigned char *&ip, const unsigned char *end,
+                 size_t &length) {
+  unsigned char byte;
+  do {
+    if (ip >= end)
+      return false;
+    byte = *ip++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+} // namespace
+
+size_t cppiper::compress_bound(size_t len) { return len + len / 255 + 16; }
+
+size_t cppiper::compress_block(const char *src, size_t len, char *dst,
+                               size_t capacity) {
+  if (len > COMPRESS_MAX_INPUT)
+    return 0;
+  thread_local uint32_t table[1 << HASH_LOG];
+  std::memset(table, 0, sizeof(table));
+  char *op(dst);
+  char *const op_end(dst + capacity);
+  size_t anchor(0);
+  const auto emit = [&](size_t literals, size_t offset, size_t match) {
+    const size_t needed(1 + literals + literals / 255 + 1 +
+                        (match ? 2 + match / 255 + 1 : 0));
+    if (static_cast<size_t>(op_end - op) < needed)
+      return false;
+    char *const token(op++);
+    const size_t literal_code(std::min<size_t>(literals, 15));
+    if (literals >= 15)
+      op = write_length(op, literals - 15);
+    std::memcpy(op, src + anchor, literals);
+    op += literals;
+    size_t match_code(0);
+    if (match) {
+      *op++ = static_cast<char>(offset & 0xFF);
+      *op++ = static_cast<char>(offset >> 8);
+      match_code = std::min<size_t>(match - MIN_MATCH, 15);
+      if (match - MIN_MATCH >= 15)
+        op = write_length(op, match - MIN_MATCH - 15);
+    }
+    *token = static_cast<char>((literal_code << 4) | match_code);
+    return true;
+  };
+  if (len > MATCH_FIND_LIMIT) {
+    const size_t find_limit(len - MATCH_FIND_LIMIT);
+    const size_t match_limit(len - LAST_LITERALS);
+    size_t ip(0);
+    unsigned int misses(0);
+    while (ip < find_limit) {
+      const uint32_t sequence(read32(src + ip));
+      uint32_t &slot(table[hash32(sequence)]);
+      const size_t candidate(slot);
+      slot = static_cast<uint32_t>(ip);
+      if (candidate >= ip or ip - candidate > MAX_OFFSET or
+          read32(src + candidate) != sequence) {
+        ip += 1 + (misses++ >> SKIP_TRIGGER);
+        continue;
+      }
+      misses = 0;
+      size_t start(ip), reference(candidate);
+      while (start > anchor and reference > 0 and
+             src[start - 1] == src[reference - 1]) {
+        start--;
+        reference--;
+      }
+      size_t match(MIN_MATCH + ip - start);
+      while (start + match < match_limit and
+             src[reference + match] == src[start + match])
+        match++;
+      if (not emit(start - anchor, start - reference, match))
+        return 0;
+      ip = anchor = start + match;
+      if (ip < find_limit)
+        table[hash32(read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2);
+    }
+  }
+  if (not emit(len - anchor, 0, 0))
+    return 0;
+  return op - dst;
+}
+
+bool cppiper::decompress_block(const char *src, size_t len, char *dst,
+                               size_t raw_len) {
+  const unsigned char *ip(reinterpret_cast<const unsigned char *>(src));
+  const unsigned char *const end(ip + len);
+  size_t op(0);
+  while (ip < end) {
+    const unsigned char token(*ip++);
+    size_t literals(token >> 4);
+    if (literals == 15 and not read_length(ip, end, literals))
+      return false;
+    if (literals > static_cast<size_t>(end - ip) or literals > raw_len - op)
+      return false;
+    std::memcpy(dst + op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == end)
+      break;
+    if (end - ip < 2)
+      return false;
+    const size_t offset(ip[0] | (ip[1] << 8));
+    ip += 2;
+    size_t match(token & 15);
+    if (match == 15 and not read_length(ip, end, match))
+      return false;
+    match += MIN_MATCH;
+    if (offset == 0 or offset > op or match > raw_len - op)
+      return false;
+    if (offset >= match) {
+      std::memcpy(dst + op, dst + op - offset, match);
+    } else {
+      for (size_t i = 0; i < match; i++)
+        dst[op + i] = dst[op + i - offset];
+    }
+    op += match;
+  }
+  return op == raw_len;
+}
@@ -0,0 +1,73 @@
+#include "../include/coroutine.hh"
+#include "cppiperconfig.hh"
+#include <utility>
+
+cppiper::ReceiveOperation::ReceiveOperation(
+    Receiver &receiver, std::chrono::steady_clock::time_point deadline)
+    : receiver(receiver), deadline(deadline), result(), handle(),
+      completed(false) {}
+
+bool cppiper::ReceiveOperation::await_ready(void) const noexcept {
+  return false;
+}
+
+bool cppiper::ReceiveOperation::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  receiver.receive_async(
+      [this](std::optional<Message> msg) {
+        result = std::move(msg);
+        if (completed.exchange(true))
+          this->handle.resume();
+      },
+      deadline);
+  return not completed.exchange(true);
+}
+
+std::optional<cppiper::Message> cppiper::ReceiveOperation::await_resume(void) {
+  return std::move(result);
+}
+
+cppiper::SendOperation::SendOperation(
+    Sender &sender, std::string msg,
+    std::chrono::steady_clock::time_point deadline)
+    : sender(sender), msg(std::move(msg)), deadline(deadline), result(false),
+      handle(), completed(false) {}
+
+bool cppiper::SendOperation::await_ready(void) const noexcept { return false; }
+
+bool cppiper::SendOperation::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  sender.send_async(
+      std::move(msg),
+      [this](bool sent) {
+        result = sent;
+        if (completed.exchange(true))
+          this->handle.resume();
+      },
+      deadline);
+  return not completed.exchange(true);
+}
+
+bool cppiper::SendOperation::await_resume(void) { return result; }
+
+cppiper::ReceiveOperation
+cppiper::async_receive(Receiver &receiver,
+                       std::chrono::steady_clock::time_point deadline) {
+  return ReceiveOperation(receiver, deadline);
+}
+
+cppiper::ReceiveOperation
+cppiper::async_receive(Receiver &receiver, std::chrono::nanoseconds timeout) {
+  return ReceiveOperation(receiver, deadline_after(timeout));
+}
+
+cppiper::SendOperation
+cppiper::async_send(Sender &sender, std::string msg,
+                    std::chrono::steady_clock::time_point deadline) {
+  return SendOperation(sender, std::move(msg), deadline);
+}
+
+cppiper::SendOperation cppiper::async_send(Sender &sender, std::string msg,
+                                           std::chrono::nanoseconds timeout) {
+  return SendOperation(sender, std::move(msg), deadline_after(timeout));
+}
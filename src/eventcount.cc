@@ -0,0 +1,68 @@
+#include "../include/eventcount.hh"
+#include "cppiperconfig.hh"
+#include <cerrno>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+//! Issue a futex operation on a 32-bit word.
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value,
+                  const timespec *timeout) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value,
+                 timeout, nullptr, 0);
+}
+
+cppiper::EventCount::EventCount(bool process_shared)
+    : epoch(0), waiters(0), process_shared(process_shared) {}
+
+void cppiper::EventCount::wake(int count) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters.load(std::memory_order_relaxed) == 0)
+    return;
+  epoch.fetch_add(1, std::memory_order_seq_cst);
+  futex(&epoch, process_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count,
+        nullptr);
+}
+
+uint32_t cppiper::EventCount::prepare_wait(void) {
+  waiters.fetch_add(1, std::memory_order_seq_cst);
+  return epoch.load(std::memory_order_seq_cst);
+}
+
+void cppiper::EventCount::cancel_wait(void) {
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void cppiper::EventCount::commit_wait(uint32_t key) {
+  while (epoch.load(std::memory_order_seq_cst) == key)
+    futex(&epoch, process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, key,
+          nullptr);
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+bool cppiper::EventCount::commit_wait(uint32_t key,
+                                      std::chrono::nanoseconds timeout) {
+  const auto deadline(std::chrono::steady_clock::now() + timeout);
+  bool notified(true);
+  while (epoch.load(std::memory_order_seq_cst) == key) {
+    const auto remaining(deadline - std::chrono::steady_clock::now());
+    if (remaining <= std::chrono::nanoseconds::zero()) {
+      notified = false;
+      break;
+    }
+    const auto seconds(
+        std::chrono::duration_cast<std::chrono::seconds>(remaining));
+    const timespec ts{static_cast<time_t>(seconds.count()),
+                      static_cast<long>((remaining - seconds).count())};
+    futex(&epoch, process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, key,
+          &ts);
+  }
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+  return notified;
+}
+
+void cppiper::EventCount::notify_one(void) { wake(1); }
+
+void cppiper::EventCount::notify_all(void) { wake(INT_MAX); }
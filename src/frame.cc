@@ -0,0 +1,137 @@
+#include "../include/frame.hh"
+#include "cppiperconfig.hh"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+//! Reflected CRC32C polynomial.
+const uint32_t CRC32C_POLY = 0x82F63B78;
+
+//! Build the byte-wise CRC32C lookup table.
+constexpr std::array<uint32_t, 256> make_crc32c_table(void) {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> crc32c_table = make_crc32c_table();
+
+uint32_t crc32c_sw(const unsigned char *data, size_t len, uint32_t crc) {
+  while (len--)
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ *data++) & 0xFF];
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t
+crc32c_hw(const unsigned char *data, size_t len, uint32_t crc) {
+  uint64_t crc64 = crc;
+  for (; len >= 8; data += 8, len -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (len--)
+    crc = _mm_crc32_u8(crc, *data++);
+  return crc;
+}
+
+const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+} // namespace
+
+void cppiper::encode_header(const FrameHeader &header, char *out) {
+  std::memcpy(out, &header, FRAME_HEADER_SIZE);
+}
+
+bool cppiper::decode_header(const char *in, FrameHeader &header) {
+  std::memcpy(&header, in, FRAME_HEADER_SIZE);
+  return header.magic == FRAME_MAGIC;
+}
+
+size_t cppiper::extensions_size(uint16_t flags) {
+  return __builtin_popcount(flags & FRAME_EXTENSION_FLAGS) *
+         FRAME_EXTENSION_SIZE;
+}
+
+size_t cppiper::encode_extensions(uint16_t flags,
+                                  const FrameExtensions &extensions,
+                                  char *out) {
+  char *const start(out);
+  if (flags & FLAG_COMPRESSED) {
+    std::memcpy(out, &extensions.raw_length, FRAME_EXTENSION_SIZE);
+    out += FRAME_EXTENSION_SIZE;
+  }
+  if (flags & FLAG_TYPED) {
+    std::memcpy(out, &extensions.type_tag, FRAME_EXTENSION_SIZE);
+    out += FRAME_EXTENSION_SIZE;
+  }
+  if (flags & FLAG_CORRELATED) {
+    std::memcpy(out, &extensions.correlation_id, FRAME_EXTENSION_SIZE);
+    out += FRAME_EXTENSION_SIZE;
+  }
+  return out - start;
+}
+
+void cppiper::decode_extensions(uint16_t flags, const char *in,
+                                FrameExtensions &extensions) {
+  extensions = FrameExtensions{};
+  if (flags & FLAG_COMPRESSED) {
+    std::memcpy(&extensions.raw_length, in, FRAME_EXTENSION_SIZE);
+    in += FRAME_EXTENSION_SIZE;
+  }
+  if (flags & FLAG_TYPED) {
+    std::memcpy(&extensions.type_tag, in, FRAME_EXTENSION_SIZE);
+    in += FRAME_EXTENSION_SIZE;
+  }
+  if (flags & FLAG_CORRELATED) {
+    std::memcpy(&extensions.correlation_id, in, FRAME_EXTENSION_SIZE);
+    in += FRAME_EXTENSION_SIZE;
+  }
+}
+
+void cppiper::encode_hex_header(uint64_t length, char *out) {
+  const static char hexChar[] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                 '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+  for (int i = HEX_HEADER_SIZE - 1; i >= 0; i--, length >>= 4)
+    out[i] = hexChar[length & 0xF];
+}
+
+bool cppiper::decode_hex_header(const char *in, uint64_t &length) {
+  length = 0;
+  for (size_t i = 0; i < HEX_HEADER_SIZE; i++) {
+    const char c = in[i];
+    uint64_t digit;
+    if (c >= '0' and c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' and c <= 'f')
+      digit = c - 'a' + 10;
+    else if (c >= 'A' and c <= 'F')
+      digit = c - 'A' + 10;
+    else
+      return false;
+    length = (length << 4) | digit;
+  }
+  return length <= HEX_MAX_LENGTH;
+}
+
+uint32_t cppiper::crc32c(const void *data, size_t len, uint32_t crc) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (has_sse42)
+    return ~crc32c_hw(bytes, len, crc);
+#endif
+  return ~crc32c_sw(bytes, len, crc);
+}
@@ -0,0 +1,47 @@
+#ifndef LOGGING_HH_
+#define LOGGING_HH_
+#include "../include/trace.hh"
+#include "cppiperconfig.hh"
+#include <glog/logging.h>
+
+//! Per-message and per-batch events.
+#define CPPIPER_LOG_TRACE 0
+//! Endpoint lifecycle and flow control events.
+#define CPPIPER_LOG_DEBUG 1
+//! Only glog LOG() statements.
+#define CPPIPER_LOG_INFO 2
+
+namespace cppiper {
+
+//! Swallows a log statement compiled out by its level.
+struct LogVoidify {
+  template <typename Stream> void operator&(const Stream &) {}
+};
+
+} // namespace cppiper
+
+//! Log at a library level, compiled out entirely below CPPIPER_LOG_LEVEL.
+/*!
+  The stream expression stays in the unevaluated branch of a constant
+  condition, so it is still type checked but generates no code.
+ */
+#define CPPIPER_LOG(level)                                                    \
+  static_cast<void>(0), CPPIPER_LOG_##level < CPPIPER_LOG_LEVEL                \
+                            ? (void)0                                          \
+                            : cppiper::LogVoidify() & LOG(INFO)
+
+//! Log a per-message or per-batch event.
+#define TRACE_LOG CPPIPER_LOG(TRACE)
+
+//! Log an endpoint lifecycle or flow control event.
+#define DEBUG_LOG CPPIPER_LOG(DEBUG)
+
+//! Record an event in the trace ring (compiled out unless CPPIPER_TRACE).
+#if CPPIPER_TRACE == ON
+#define TRACE_EVENT(event, endpoint, value)                                    \
+  cppiper::TraceRing::record(cppiper::TraceEvent::event, endpoint, value)
+#else
+#define TRACE_EVENT(event, endpoint, value) static_cast<void>(0)
+#endif
+
+#endif // LOGGING_HH_
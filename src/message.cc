@@ -0,0 +1,59 @@
+#include "../include/message.hh"
+#include "../include/bufferpool.hh"
+#include "cppiperconfig.hh"
+#include <utility>
+
+cppiper::Message::Message(std::shared_ptr<BufferPool> pool,
+                          std::unique_ptr<char[]> buffer, size_t capacity,
+                          size_t length)
+    : pool(std::move(pool)), buffer(std::move(buffer)), capacity(capacity),
+      length(length), tag(0), correlation(0) {}
+
+cppiper::Message::Message(void)
+    : pool(), buffer(), capacity(0), length(0), tag(0), correlation(0) {}
+
+cppiper::Message::Message(Message &&other) noexcept
+    : pool(std::move(other.pool)), buffer(std::move(other.buffer)),
+      capacity(std::exchange(other.capacity, 0)),
+      length(std::exchange(other.length, 0)),
+      tag(std::exchange(other.tag, 0)),
+      correlation(std::exchange(other.correlation, 0)) {}
+
+cppiper::Message &cppiper::Message::operator=(Message &&other) noexcept {
+  if (this != &other) {
+    if (pool)
+      pool->release(std::move(buffer), capacity);
+    pool = std::move(other.pool);
+    buffer = std::move(other.buffer);
+    capacity = std::exchange(other.capacity, 0);
+    length = std::exchange(other.length, 0);
+    tag = std::exchange(other.tag, 0);
+    correlation = std::exchange(other.correlation, 0);
+  }
+  return *this;
+}
+
+cppiper::Message::~Message(void) {
+  if (pool)
+    pool->release(std::move(buffer), capacity);
+}
+
+const char *cppiper::Message::data(void) const { return buffer.get(); }
+
+char *cppiper::Message::data(void) { return buffer.get(); }
+
+size_t cppiper::Message::size(void) const { return length; }
+
+bool cppiper::Message::empty(void) const { return length == 0; }
+
+std::string_view cppiper::Message::view(void) const {
+  return std::string_view(buffer.get(), length);
+}
+
+std::string cppiper::Message::str(void) const {
+  return std::string(buffer.get(), length);
+}
+
+uint64_t cppiper::Message::type_tag(void) const { return tag; }
+
+uint64_t cppiper::Message::correlation_id(void) const { return correlation; }
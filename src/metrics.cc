@@ -0,0 +1,104 @@
+#include "../include/metrics.hh"
+#include "cppiperconfig.hh"
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+
+//! Identifier of the next endpoint.
+std::atomic<uint32_t> next_endpoint_id(1);
+
+} // namespace
+
+cppiper::EndpointCounters::EndpointCounters(void)
+    : id(next_endpoint_id.fetch_add(1, std::memory_order_relaxed)),
+      messages(0), bytes(0), syscalls(0), short_transfers(0), eagain(0),
+      eintr(0), queue_depth(0), max_queue_depth(0), blocked_nanoseconds(0) {}
+
+uint32_t cppiper::EndpointCounters::get_id(void) const { return id; }
+
+void cppiper::EndpointCounters::count_messages(uint64_t count) {
+  messages.fetch_add(count, std::memory_order_relaxed);
+}
+
+void cppiper::EndpointCounters::count_bytes(uint64_t count) {
+  bytes.fetch_add(count, std::memory_order_relaxed);
+}
+
+void cppiper::EndpointCounters::count_syscall(ssize_t result,
+                                              size_t requested) {
+  syscalls.fetch_add(1, std::memory_order_relaxed);
+  if (result < 0) {
+    if (errno == EAGAIN)
+      eagain.fetch_add(1, std::memory_order_relaxed);
+    else if (errno == EINTR)
+      eintr.fetch_add(1, std::memory_order_relaxed);
+  } else if (result > 0 and static_cast<size_t>(result) < requested) {
+    short_transfers.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void cppiper::EndpointCounters::observe_depth(size_t depth) {
+  queue_depth.store(depth, std::memory_order_relaxed);
+  uint64_t max(max_queue_depth.load(std::memory_order_relaxed));
+  while (depth > max and not max_queue_depth.compare_exchange_weak(
+                             max, depth, std::memory_order_relaxed))
+    ;
+}
+
+void cppiper::EndpointCounters::count_blocked(
+    std::chrono::nanoseconds duration) {
+  blocked_nanoseconds.fetch_add(std::max<int64_t>(duration.count(), 0),
+                                std::memory_order_relaxed);
+}
+
+uint64_t cppiper::EndpointCounters::get_messages(void) const {
+  return messages.load(std::memory_order_relaxed);
+}
+
+uint64_t cppiper::EndpointCounters::get_syscalls(void) const {
+  return syscalls.load(std::memory_order_relaxed);
+}
+
+void cppiper::EndpointCounters::snapshot(EndpointStats &stats) const {
+  stats.id = id;
+  stats.messages = messages.load(std::memory_order_relaxed);
+  stats.bytes = bytes.load(std::memory_order_relaxed);
+  stats.syscalls = syscalls.load(std::memory_order_relaxed);
+  stats.short_transfers = short_transfers.load(std::memory_order_relaxed);
+  stats.eagain = eagain.load(std::memory_order_relaxed);
+  stats.eintr = eintr.load(std::memory_order_relaxed);
+  stats.queue_depth = queue_depth.load(std::memory_order_relaxed);
+  stats.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+  stats.blocked_nanoseconds =
+      blocked_nanoseconds.load(std::memory_order_relaxed);
+}
+
+cppiper::MetricsRegistry::MetricsRegistry(void) : lock(), sources() {}
+
+cppiper::MetricsRegistry &cppiper::MetricsRegistry::instance(void) {
+  // Never destroyed, so endpoints with static storage duration can still
+  // unregister during exit.
+  static MetricsRegistry *const registry(new MetricsRegistry());
+  return *registry;
+}
+
+void cppiper::MetricsRegistry::add(const MetricsSource *source) {
+  std::lock_guard lk(lock);
+  sources.push_back(source);
+}
+
+void cppiper::MetricsRegistry::remove(const MetricsSource *source) {
+  std::lock_guard lk(lock);
+  sources.erase(std::remove(sources.begin(), sources.end(), source),
+                sources.end());
+}
+
+std::vector<cppiper::EndpointStats> cppiper::MetricsRegistry::snapshot(void) {
+  std::lock_guard lk(lock);
+  std::vector<EndpointStats> snapshots;
+  snapshots.reserve(sources.size());
+  for (const MetricsSource *source : sources)
+    snapshots.push_back(source->stats());
+  return snapshots;
+}
@@ -1,77 +1,317 @@
 #include "../include/pipemanager.hh"
 #include "cppiperconfig.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <glog/logging.h>
 #include <mutex>
+#include <random>
+#include <signal.h>
 #include <string>
 #include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char HEX_CHARS[] = "0123456789ABCDEF";
+//! Hex digits of the owner PID at the start of a generated pipe name.
+const size_t PID_DIGITS = 8;
+//! Hex digits of the per-process counter following the owner PID.
+const size_t COUNTER_DIGITS = 8;
+
+//! Counter making generated pipe names unique within the process.
+std::atomic<uint32_t> pipe_counter(0);
+
+//! Get the next value of a per-thread xorshift64* generator.
+/*!
+  \return 64 random bits.
+ */
+uint64_t next_random(void) {
+  thread_local uint64_t state([] {
+    std::random_device device;
+    const uint64_t seed((static_cast<uint64_t>(device()) << 32) ^ device());
+    return seed ? seed : 0x9E3779B97F4A7C15ULL;
+  }());
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545F4914F6CDD1DULL;
+}
+
+//! Write the low hex digits of a value.
+/*!
+  \param out where to write the digits.
+  \param value value to write.
+  \param digits number of digits to write.
+ */
+void write_hex(char *out, uint64_t value, size_t digits) {
+  for (size_t i = digits; i > 0; i--, value >>= 4)
+    out[i - 1] = HEX_CHARS[value & 0xF];
+}
+
+//! Get the last time a pipe was opened, read or written.
+/*!
+  \param st pipe status.
+  \return Seconds since the epoch.
+ */
+time_t last_activity(const struct stat &st) {
+  return std::max({st.st_atim.tv_sec, st.st_mtim.tv_sec, st.st_ctim.tv_sec});
+}
+
+} // namespace
 
 std::string cppiper::random_hex(int len) {
-  const static char hexChar[] = {'0', '1', '2', '3', '4', '5', '6', '7',
-                                 '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-  std::stringstream ss;
-  for (int j = 0; j < len; j++)
-    ss << hexChar[rand() % 16];
-  return ss.str();
+  std::string hex(std::max(len, 0), '0');
+  for (int i = 0; i < len; i += 16)
+    write_hex(hex.data() + i, next_random(),
+              std::min<size_t>(16, static_cast<size_t>(len - i)));
+  return hex;
 }
 
-cppiper::PipeManager::PipeManager(const std::filesystem::path pipedir)
-    : lock(), pipedir(std::filesystem::absolute(pipedir)) {
+pid_t cppiper::pipe_owner(const std::string &pipename) {
+  // <pid>-<counter>-<random>
+  if (pipename.size() != PIPE_LENGTH or pipename[PID_DIGITS] != '-' or
+      pipename[PID_DIGITS + 1 + COUNTER_DIGITS] != '-')
+    return 0;
+  uint32_t pid(0);
+  for (size_t i = 0; i < PID_DIGITS; i++) {
+    const char *const digit(std::strchr(HEX_CHARS, pipename[i]));
+    if (not digit or not *digit)
+      return 0;
+    pid = pid << 4 | static_cast<uint32_t>(digit - HEX_CHARS);
+  }
+  return pid <= INT32_MAX ? static_cast<pid_t>(pid) : 0;
+}
+
+cppiper::PipeManager::PipeManager(const std::filesystem::path pipedir,
+                                  size_t pool_limit)
+    : lock(), pipedir(std::filesystem::absolute(pipedir)),
+      pool_limit(pool_limit), pool(), leased(), collector_lock(),
+      collector_conditional(), collector_running(false), collector() {
   if (not std::filesystem::exists(this->pipedir)) {
-    DLOG(INFO) << "Creating pipe directory " << this->pipedir << "...";
+    DEBUG_LOG << "Creating pipe directory " << this->pipedir << "...";
     std::filesystem::create_directories(pipedir);
   }
+  pool.reserve(pool_limit);
   LOG(INFO) << "Constructed pipe manager for directory " << this->pipedir;
 }
 
-std::filesystem::path cppiper::PipeManager::make_pipe(void) {
-  std::filesystem::path pipepath;
+cppiper::PipeManager::~PipeManager(void) {
+  stop_collector();
   std::lock_guard lk(lock);
-  while (std::filesystem::exists(
-      pipepath = pipedir.string() + std::filesystem::path::preferred_separator +
-                 random_hex(PIPE_LENGTH))) {
-    DLOG(INFO) << "Pipe miss at " << pipepath;
-  };
-  mkfifo(pipepath.c_str(), 00666);
-  DLOG(INFO) << "New pipe created at " << pipepath;
-  return pipepath;
+  for (const std::filesystem::path &pipepath : pool)
+    unlink_pipe(pipepath);
+  DEBUG_LOG << "Removed " << pool.size() << " pooled pipes from "
+            << pipedir;
+}
+
+std::filesystem::path
+cppiper::PipeManager::pipe_path(const std::string &pipename) const {
+  return pipedir.string() + std::filesystem::path::preferred_separator +
+         pipename;
+}
+
+std::filesystem::path cppiper::PipeManager::make_pipe(void) {
+  std::string pipename(PIPE_LENGTH, '-');
+  write_hex(pipename.data(), static_cast<uint64_t>(getpid()), PID_DIGITS);
+  // Only a PID reused since a crash can collide, so mkfifo doubles as the
+  // existence check and a miss just moves on to the next counter value.
+  for (;;) {
+    write_hex(pipename.data() + PID_DIGITS + 1,
+              pipe_counter.fetch_add(1, std::memory_order_relaxed),
+              COUNTER_DIGITS);
+    write_hex(pipename.data() + PID_DIGITS + COUNTER_DIGITS + 2,
+              next_random(), PIPE_LENGTH - PID_DIGITS - COUNTER_DIGITS - 2);
+    const std::filesystem::path pipepath(pipe_path(pipename));
+    if (mkfifo(pipepath.c_str(), 00666) == 0) {
+      DEBUG_LOG << "New pipe created at " << pipepath;
+      return pipepath;
+    }
+    if (errno != EEXIST) {
+      const std::string errmsg("Failed to make pipe " + pipepath.string());
+      LOG(ERROR) << errmsg << ", " << std::strerror(errno);
+      throw std::filesystem::filesystem_error(
+          errmsg, std::error_code(errno, std::generic_category()));
+    }
+    DEBUG_LOG << "Pipe miss at " << pipepath;
+  }
 }
 
 std::filesystem::path cppiper::PipeManager::make_pipe(const std::string& pipename) {
-  std::lock_guard lk(lock);
-  std::filesystem::path pipepath(pipedir.string() + std::filesystem::path::preferred_separator + pipename);
-  if (std::filesystem::exists(pipepath))
+  const std::filesystem::path pipepath(pipe_path(pipename));
+  if (mkfifo(pipepath.c_str(), 00666) == -1)
   {
-    const std::string errmsg("Attempt to make pipe " + pipepath.string() + " that already exists");
-    LOG(ERROR) << pipepath.string();
-    throw std::filesystem::filesystem_error(errmsg, std::make_error_code(std::errc::file_exists));
+    const std::string errmsg(errno == EEXIST ? "Attempt to make pipe " + pipepath.string() + " that already exists" : "Failed to make pipe " + pipepath.string());
+    LOG(ERROR) << errmsg;
+    throw std::filesystem::filesystem_error(errmsg, std::error_code(errno, std::generic_category()));
+  }
+  DEBUG_LOG << "New pipe created at " << pipepath;
+  return pipepath;
+}
+
+size_t cppiper::PipeManager::reserve(size_t count) {
+  count = std::min(count, pool_limit);
+  std::lock_guard lk(lock);
+  while (pool.size() < count)
+    pool.push_back(make_pipe());
+  DEBUG_LOG << "Pipe pool of " << pipedir << " holds " << pool.size()
+            << " pipes";
+  return pool.size();
+}
+
+std::filesystem::path cppiper::PipeManager::lease(void) {
+  std::lock_guard lk(lock);
+  while (not pool.empty()) {
+    std::filesystem::path pipepath(std::move(pool.back()));
+    pool.pop_back();
+    // Skip pipes removed behind the pool's back, e.g. by another process.
+    struct stat st;
+    if (stat(pipepath.c_str(), &st) == 0 and S_ISFIFO(st.st_mode)) {
+      leased.insert(pipepath);
+      TRACE_LOG << "Leased pooled pipe " << pipepath;
+      return pipepath;
+    }
+    LOG(WARNING) << "Pooled pipe " << pipepath << " disappeared";
   }
-  DLOG(INFO) << "New pipe created at " << pipepath;
+  // Created under the lock so a collection cannot see it before it is leased.
+  const std::filesystem::path pipepath(make_pipe());
+  leased.insert(pipepath);
   return pipepath;
 }
 
+bool cppiper::PipeManager::recycle(const std::filesystem::path &pipepath) {
+  const std::filesystem::path path(pipe_path(pipepath.filename()));
+  std::lock_guard lk(lock);
+  leased.erase(path);
+  if (pool.size() < pool_limit) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 or not S_ISFIFO(st.st_mode)) {
+      LOG(WARNING) << "Attempt to recycle missing pipe " << path;
+      return false;
+    }
+    pool.push_back(path);
+    TRACE_LOG << "Recycled pipe " << path;
+    return true;
+  }
+  unlink_pipe(path);
+  DEBUG_LOG << "Pipe pool full, removed pipe " << path;
+  return false;
+}
+
+bool cppiper::PipeManager::make_segment(const std::string& pipename,
+                                        size_t capacity) {
+  std::lock_guard lk(lock);
+  return ShmRing::create_segment(pipe_path(pipename), capacity);
+}
+
+bool cppiper::PipeManager::unlink_pipe(const std::filesystem::path &pipepath) {
+  std::error_code ec;
+  const bool removed(std::filesystem::remove(pipepath, ec));
+  ShmRing::remove_segment(pipepath);
+  return removed;
+}
+
 bool cppiper::PipeManager::remove_pipe(const std::string& pipename) {
   std::lock_guard lk(lock);
-  const std::filesystem::path pipepath(pipedir.string() + std::filesystem::path::preferred_separator + pipename);
+  const std::filesystem::path pipepath(pipe_path(pipename));
   if (not std::filesystem::exists(pipepath)) {
     LOG(WARNING) << "Pipe " << pipepath << " does not exist";
     return false;
   }
-  std::filesystem::remove(pipepath);
-  DLOG(INFO) << "Removed pipe " << pipename;
+  pool.erase(std::remove(pool.begin(), pool.end(), pipepath), pool.end());
+  leased.erase(pipepath);
+  unlink_pipe(pipepath);
+  DEBUG_LOG << "Removed pipe " << pipename;
   return true;
 };
 
+size_t cppiper::PipeManager::collect(std::chrono::seconds idle_ttl) {
+  std::lock_guard lk(lock);
+  const time_t now(std::time(nullptr));
+  size_t removed(0);
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(pipedir, ec)) {
+    struct stat st;
+    if (stat(entry.path().c_str(), &st) == -1 or not S_ISFIFO(st.st_mode))
+      continue;
+    const pid_t owner(pipe_owner(entry.path().filename()));
+    // EPERM means the owner is alive but belongs to another user.
+    const bool orphaned(owner > 0 and kill(owner, 0) == -1 and
+                        errno == ESRCH);
+    const bool idle(idle_ttl.count() > 0 and
+                    now - last_activity(st) >= idle_ttl.count() and
+                    std::find(pool.begin(), pool.end(), entry.path()) ==
+                        pool.end() and
+                    leased.count(entry.path()) == 0);
+    if (not orphaned and not idle)
+      continue;
+    if (unlink_pipe(entry.path())) {
+      removed++;
+      DEBUG_LOG << "Collected " << (orphaned ? "orphaned" : "idle")
+                << " pipe " << entry.path();
+    }
+  }
+  if (ec)
+    LOG(ERROR) << "Failed to scan pipe directory " << pipedir << ", "
+               << ec.message();
+  if (removed > 0)
+    LOG(INFO) << "Collected " << removed << " pipes from " << pipedir;
+  return removed;
+}
+
+void cppiper::PipeManager::collect_loop(std::chrono::milliseconds interval,
+                                        std::chrono::seconds idle_ttl) {
+  DEBUG_LOG << "Pipe collector started for " << pipedir;
+  std::unique_lock lk(collector_lock);
+  while (not collector_conditional.wait_for(
+      lk, interval, [this] { return not collector_running; })) {
+    lk.unlock();
+    collect(idle_ttl);
+    lk.lock();
+  }
+  DEBUG_LOG << "Pipe collector stopped for " << pipedir;
+}
+
+bool cppiper::PipeManager::start_collector(std::chrono::milliseconds interval,
+                                           std::chrono::seconds idle_ttl) {
+  std::lock_guard lk(collector_lock);
+  if (collector_running or collector.joinable()) {
+    LOG(WARNING) << "Pipe collector already running for " << pipedir;
+    return false;
+  }
+  collector_running = true;
+  collector = std::thread(&PipeManager::collect_loop, this, interval,
+                          idle_ttl);
+  return true;
+}
+
+void cppiper::PipeManager::stop_collector(void) {
+  {
+    std::lock_guard lk(collector_lock);
+    collector_running = false;
+  }
+  collector_conditional.notify_all();
+  if (collector.joinable())
+    collector.join();
+}
+
 void cppiper::PipeManager::clear(void) {
   std::lock_guard lk(lock);
-  DLOG(INFO) << "Clearing pipes...";
+  DEBUG_LOG << "Clearing pipes...";
+  pool.clear();
+  leased.clear();
   if (not std::filesystem::exists(pipedir)) {
     LOG(ERROR) << "Attempt to clear non-existent pipe directory " << pipedir
                << ", " << errno;
   } else {
     for (const auto &entry : std::filesystem::directory_iterator(pipedir)) {
       std::filesystem::remove(entry.path());
-      DLOG(INFO) << "Removed pipe at " << entry.path().string();
+      ShmRing::remove_segment(entry.path());
+      DEBUG_LOG << "Removed pipe at " << entry.path().string();
     }
   }
 }
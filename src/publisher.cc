@@ -0,0 +1,341 @@
+#include "../include/publisher.hh"
+#include "cppiperconfig.hh"
+#include "logging.hh"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+//! Most buffered frames written by a single writev.
+const size_t FLUSH_FRAME_LIMIT = 64;
+
+static_assert(2 * FLUSH_FRAME_LIMIT <= IOV_MAX,
+              "FLUSH_FRAME_LIMIT must fit in an iovec array");
+
+//! Ignore SIGPIPE unless the process already handles it.
+/*!
+  A subscriber closing its pipe would otherwise kill the process on the next
+  write instead of failing it with EPIPE.
+ */
+void ignore_sigpipe(void) {
+  struct sigaction action;
+  if (sigaction(SIGPIPE, nullptr, &action) == 0 and
+      action.sa_handler == SIG_DFL) {
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, nullptr);
+    DEBUG_LOG << "Ignoring SIGPIPE for subscribers closing their pipe";
+  }
+}
+
+} // namespace
+
+void cppiper::Publisher::Subscriber::handle_events(uint32_t events) {
+  std::lock_guard lk(lock);
+  if (pipe_fd == -1 or closing)
+    return;
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    DEBUG_LOG << "Subscriber " << id << " closed pipe "
+              << pipepath.filename();
+    closing = true;
+    return;
+  }
+  if (not flush())
+    closing = true;
+}
+
+bool cppiper::Publisher::Subscriber::flush(void) {
+  while (not backlog.empty()) {
+    iovec iov[2 * FLUSH_FRAME_LIMIT];
+    int iov_count(0);
+    for (auto pending(backlog.begin());
+         pending != backlog.end() and
+         iov_count + 2 <= static_cast<int>(2 * FLUSH_FRAME_LIMIT);
+         ++pending) {
+      const Broadcast &frame(*pending->frame);
+      size_t skip(pending->written);
+      if (skip < frame.header_size) {
+        iov[iov_count++] = {const_cast<char *>(frame.header) + skip,
+                            frame.header_size - skip};
+        skip = 0;
+      } else
+        skip -= frame.header_size;
+      if (skip < frame.payload.size())
+        iov[iov_count++] = {const_cast<char *>(frame.payload.data()) + skip,
+                            frame.payload.size() - skip};
+    }
+    const ssize_t bytes_written(writev(pipe_fd, iov, iov_count));
+    if (bytes_written == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        return true;
+      if (errno != EPIPE)
+        LOG(ERROR) << "Error writing to subscriber " << id << " on pipe "
+                   << pipepath.filename() << ": " << std::strerror(errno);
+      return false;
+    }
+    backlog_bytes -= bytes_written;
+    size_t remaining(bytes_written);
+    while (remaining > 0) {
+      Pending &pending(backlog.front());
+      const size_t left(pending.frame->header_size +
+                        pending.frame->payload.size() - pending.written);
+      if (remaining < left) {
+        pending.written += remaining;
+        break;
+      }
+      remaining -= left;
+      backlog.pop_front();
+    }
+  }
+  return true;
+}
+
+cppiper::Publisher::Publisher(const std::string name, PipeManager &pipemanager,
+                              const PublisherOptions &options)
+    : name(name), pipemanager(pipemanager), options(options),
+      own_reactor(options.reactor ? nullptr : std::make_unique<Reactor>(1)),
+      reactor(options.reactor ? options.reactor : own_reactor.get()),
+      next_id(1), lock(), subscribers() {
+  ignore_sigpipe();
+  LOG(INFO) << "Constructed publisher instance " << name;
+}
+
+cppiper::Publisher::~Publisher(void) {
+  std::vector<uint64_t> ids;
+  {
+    std::lock_guard lk(lock);
+    for (const auto &subscriber : subscribers)
+      ids.push_back(subscriber.first);
+  }
+  for (uint64_t id : ids)
+    remove(id);
+  LOG(INFO) << "Destroyed publisher instance " << name;
+}
+
+std::shared_ptr<const cppiper::Publisher::Broadcast>
+cppiper::Publisher::encode(std::string msg) const {
+  const uint64_t msg_size(msg.size());
+  auto frame(std::make_shared<Broadcast>());
+  if (options.wire_format == WireFormat::HEX) {
+    if (msg_size > HEX_MAX_LENGTH) {
+      LOG(ERROR) << "Message of " << msg_size
+                 << " bytes exceeds the hex frame limit on publisher "
+                 << name;
+      return nullptr;
+    }
+    encode_hex_header(msg_size, frame->header);
+    frame->header_size = HEX_HEADER_SIZE;
+  } else {
+    FrameHeader header{FRAME_MAGIC, FRAME_VERSION, 0, 0, msg_size};
+    if (options.checksum) {
+      header.flags |= FLAG_CHECKSUM;
+      header.checksum = crc32c(msg.data(), msg_size);
+    }
+    encode_header(header, frame->header);
+    frame->header_size = FRAME_HEADER_SIZE;
+  }
+  frame->payload = std::move(msg);
+  return frame;
+}
+
+bool cppiper::Publisher::connect(Subscriber &subscriber) {
+  // Opening the write end without blocking fails with ENXIO until the
+  // subscriber has opened the read end.
+  const int fd(open(subscriber.pipepath.c_str(), O_WRONLY | O_NONBLOCK));
+  if (fd == -1) {
+    if (errno != ENXIO) {
+      LOG(ERROR) << "Error opening pipe " << subscriber.pipepath.filename()
+                 << " of subscriber " << subscriber.id << " on publisher "
+                 << name << ": " << std::strerror(errno);
+      subscriber.closing = true;
+    }
+    return false;
+  }
+  subscriber.pipe_fd = fd;
+  subscriber.loop = reactor->choose_loop();
+  if (not reactor->attach(subscriber.loop, fd, EPOLLOUT | EPOLLET,
+                          &subscriber)) {
+    LOG(ERROR) << "Error attaching pipe " << subscriber.pipepath.filename()
+               << " of subscriber " << subscriber.id << " on publisher "
+               << name;
+    subscriber.loop = -1;
+    subscriber.closing = true;
+    return false;
+  }
+  DEBUG_LOG << "Subscriber " << subscriber.id << " connected on pipe "
+            << subscriber.pipepath.filename() << " of publisher " << name;
+  return true;
+}
+
+bool cppiper::Publisher::deliver(
+    Subscriber &subscriber, const std::shared_ptr<const Broadcast> &frame) {
+  if (subscriber.closing or
+      (subscriber.pipe_fd == -1 and not connect(subscriber)))
+    return false;
+  const size_t frame_size(frame->header_size + frame->payload.size());
+  size_t written(0);
+  if (subscriber.backlog.empty()) {
+    iovec iov[2] = {{const_cast<char *>(frame->header), frame->header_size},
+                    {const_cast<char *>(frame->payload.data()),
+                     frame->payload.size()}};
+    ssize_t bytes_written;
+    do {
+      bytes_written = writev(subscriber.pipe_fd, iov, 2);
+    } while (bytes_written == -1 and errno == EINTR);
+    if (bytes_written == -1 and errno != EAGAIN) {
+      if (errno != EPIPE)
+        LOG(ERROR) << "Error writing to subscriber " << subscriber.id
+                   << " on publisher " << name << ": "
+                   << std::strerror(errno);
+      else
+        DEBUG_LOG << "Subscriber " << subscriber.id << " closed pipe "
+                  << subscriber.pipepath.filename();
+      subscriber.closing = true;
+      return false;
+    }
+    if (bytes_written > 0)
+      written = bytes_written;
+    if (written == frame_size) {
+      subscriber.delivered++;
+      return true;
+    }
+  }
+  // A partially written frame must be completed to keep the stream framed,
+  // so the policy only applies to frames not started yet.
+  if (written == 0 and subscriber.backlog_bytes + frame_size >
+                           subscriber.options.buffer_limit) {
+    if (subscriber.options.policy == SlowConsumerPolicy::DISCONNECT) {
+      LOG(WARNING) << "Disconnecting slow subscriber " << subscriber.id
+                   << " of publisher " << name << " with "
+                   << subscriber.backlog_bytes << " bytes buffered";
+      subscriber.closing = true;
+    } else
+      subscriber.dropped++;
+    return false;
+  }
+  subscriber.backlog.push_back(Pending{frame, written});
+  subscriber.backlog_bytes += frame_size - written;
+  subscriber.delivered++;
+  return true;
+}
+
+bool cppiper::Publisher::remove(uint64_t id) {
+  std::shared_ptr<Subscriber> subscriber;
+  {
+    std::lock_guard lk(lock);
+    const auto entry(subscribers.find(id));
+    if (entry == subscribers.end())
+      return false;
+    subscriber = std::move(entry->second);
+    subscribers.erase(entry);
+  }
+  // No publish can reach the subscriber any more, and once detached neither
+  // can the reactor.
+  if (subscriber->loop != -1)
+    reactor->detach(subscriber->loop, subscriber->pipe_fd);
+  {
+    std::lock_guard lk(subscriber->lock);
+    if (subscriber->pipe_fd != -1) {
+      if (not subscriber->backlog.empty())
+        DEBUG_LOG << "Dropping " << subscriber->backlog.size()
+                  << " buffered messages of subscriber " << id;
+      close(subscriber->pipe_fd);
+      subscriber->pipe_fd = -1;
+    }
+  }
+  if (subscriber->owned)
+    pipemanager.remove_pipe(subscriber->pipepath.filename());
+  DEBUG_LOG << "Removed subscriber " << id << " from publisher " << name;
+  return true;
+}
+
+cppiper::Subscription
+cppiper::Publisher::add(const std::filesystem::path &pipepath, bool owned,
+                        const SubscriberOptions &options) {
+  const uint64_t id(next_id.fetch_add(1, std::memory_order_relaxed));
+  auto subscriber(
+      std::make_shared<Subscriber>(id, pipepath, owned, options));
+  {
+    std::lock_guard lk(lock);
+    subscribers.emplace(id, std::move(subscriber));
+  }
+  DEBUG_LOG << "Added subscriber " << id << " on pipe " << pipepath.filename()
+            << " to publisher " << name;
+  return Subscription{id, pipepath};
+}
+
+cppiper::Subscription cppiper::Publisher::subscribe(void) {
+  return subscribe(options.subscriber);
+}
+
+cppiper::Subscription
+cppiper::Publisher::subscribe(const SubscriberOptions &options) {
+  return add(pipemanager.lease(), true, options);
+}
+
+cppiper::Subscription
+cppiper::Publisher::subscribe(const std::filesystem::path &pipepath,
+                              const SubscriberOptions &options) {
+  return add(pipepath, false, options);
+}
+
+bool cppiper::Publisher::unsubscribe(uint64_t id) { return remove(id); }
+
+size_t cppiper::Publisher::publish(std::string msg) {
+  const std::shared_ptr<const Broadcast> frame(encode(std::move(msg)));
+  if (not frame)
+    return 0;
+  size_t delivered(0);
+  std::vector<uint64_t> closing;
+  {
+    std::lock_guard lk(lock);
+    for (auto &entry : subscribers) {
+      Subscriber &subscriber(*entry.second);
+      std::lock_guard slk(subscriber.lock);
+      if (deliver(subscriber, frame))
+        delivered++;
+      if (subscriber.closing)
+        closing.push_back(entry.first);
+    }
+  }
+  // Removed outside the lock, detaching waits on the reactor loop.
+  for (uint64_t id : closing)
+    remove(id);
+  TRACE_LOG << "Published message to " << delivered << " subscribers of "
+            << name;
+  return delivered;
+}
+
+size_t cppiper::Publisher::subscriber_count(void) {
+  std::lock_guard lk(lock);
+  return subscribers.size();
+}
+
+std::vector<cppiper::SubscriberStats>
+cppiper::Publisher::get_subscriber_stats(void) {
+  std::lock_guard lk(lock);
+  std::vector<SubscriberStats> snapshots;
+  snapshots.reserve(subscribers.size());
+  for (const auto &entry : subscribers) {
+    Subscriber &subscriber(*entry.second);
+    std::lock_guard slk(subscriber.lock);
+    SubscriberStats stats;
+    stats.id = subscriber.id;
+    stats.pipe = subscriber.pipepath;
+    stats.connected = subscriber.pipe_fd != -1;
+    stats.delivered = subscriber.delivered;
+    stats.dropped = subscriber.dropped;
+    stats.buffered_bytes = subscriber.backlog_bytes;
+    snapshots.push_back(stats);
+  }
+  return snapshots;
+}
@@ -0,0 +1,239 @@
+#include "../include/reactor.hh"
+#include "cppiperconfig.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <future>
+#include <glog/logging.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+//! Maximum number of events handled per loop iteration.
+static const int MAX_EVENTS = 64;
+
+std::chrono::steady_clock::time_point
+cppiper::deadline_after(std::chrono::nanoseconds timeout) {
+  const auto now(std::chrono::steady_clock::now());
+  if (timeout >= std::chrono::steady_clock::time_point::max() - now)
+    return std::chrono::steady_clock::time_point::max();
+  return now + timeout;
+}
+
+void cppiper::Reactor::run(Loop &loop) {
+  epoll_event events[MAX_EVENTS];
+  std::vector<std::function<void()>> tasks;
+  while (not stopping) {
+    const int count(
+        epoll_wait(loop.epoll_fd, events, MAX_EVENTS, next_timeout(loop)));
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG(ERROR) << "Reactor loop failed to wait for events, " << errno;
+      break;
+    }
+    bool woken(false);
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.ptr == nullptr) {
+        woken = true;
+        continue;
+      }
+      static_cast<ReactorHandler *>(events[i].data.ptr)
+          ->handle_events(events[i].events);
+    }
+    if (woken) {
+      uint64_t value;
+      if (read(loop.event_fd, &value, sizeof(value)) < 0 and errno != EAGAIN)
+        LOG(ERROR) << "Reactor loop failed to read event descriptor, "
+                   << errno;
+      {
+        std::lock_guard lk(loop.lock);
+        tasks.swap(loop.tasks);
+      }
+      for (std::function<void()> &task : tasks)
+        task();
+      tasks.clear();
+    }
+    if (loop.timer_count > 0)
+      run_timers(loop);
+  }
+  DEBUG_LOG << "Breaking from reactor loop";
+}
+
+int cppiper::Reactor::next_timeout(Loop &loop) {
+  if (loop.timer_count == 0)
+    return -1;
+  std::lock_guard lk(loop.lock);
+  if (loop.timers.empty())
+    return -1;
+  // Rounded up, so the loop never wakes just before its timer expires.
+  const auto remaining(std::chrono::ceil<std::chrono::milliseconds>(
+      loop.timers.begin()->first.first - std::chrono::steady_clock::now()));
+  return std::clamp<std::chrono::milliseconds::rep>(remaining.count(), 0,
+                                                     INT_MAX);
+}
+
+void cppiper::Reactor::run_timers(Loop &loop) {
+  std::vector<std::function<void()>> expired;
+  {
+    const auto now(std::chrono::steady_clock::now());
+    std::lock_guard lk(loop.lock);
+    while (not loop.timers.empty() and
+           loop.timers.begin()->first.first <= now) {
+      expired.emplace_back(std::move(loop.timers.begin()->second));
+      loop.timers.erase(loop.timers.begin());
+    }
+    loop.timer_count = loop.timers.size();
+  }
+  for (std::function<void()> &task : expired)
+    task();
+}
+
+cppiper::Reactor::Reactor(size_t loop_count)
+    : loops(), next_loop(0), stopping(false), next_timer(1) {
+  if (loop_count == 0)
+    loop_count = 1;
+  for (size_t i = 0; i < loop_count; i++) {
+    std::unique_ptr<Loop> loop(new Loop{-1, -1, {}, {}, {}, 0, {}});
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epoll_fd == -1 or loop->event_fd == -1) {
+      LOG(ERROR) << "Failed to create reactor loop, " << errno;
+      if (loop->epoll_fd != -1)
+        close(loop->epoll_fd);
+      if (loop->event_fd != -1)
+        close(loop->event_fd);
+      continue;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->event_fd, &event);
+    loop->thread = std::thread(&Reactor::run, this, std::ref(*loop));
+    loops.emplace_back(std::move(loop));
+  }
+  LOG(INFO) << "Constructed reactor with " << loops.size() << " loops";
+}
+
+cppiper::Reactor::~Reactor(void) {
+  stopping = true;
+  for (std::unique_ptr<Loop> &loop : loops) {
+    const uint64_t value(1);
+    if (write(loop->event_fd, &value, sizeof(value)) < 0)
+      LOG(ERROR) << "Failed to wake reactor loop, " << errno;
+    loop->thread.join();
+    close(loop->epoll_fd);
+    close(loop->event_fd);
+  }
+  DEBUG_LOG << "Destroyed reactor";
+}
+
+int cppiper::Reactor::choose_loop(void) {
+  if (loops.empty())
+    return -1;
+  return next_loop++ % loops.size();
+}
+
+bool cppiper::Reactor::attach(int loop, int fd, uint32_t events,
+                              ReactorHandler *handler) {
+  if (loop < 0 or static_cast<size_t>(loop) >= loops.size())
+    return false;
+  epoll_event event{};
+  event.events = events;
+  event.data.ptr = handler;
+  if (epoll_ctl(loops[loop]->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    LOG(ERROR) << "Failed to attach descriptor " << fd << " to reactor, "
+               << errno;
+    return false;
+  }
+  DEBUG_LOG << "Attached descriptor " << fd << " to reactor loop " << loop;
+  return true;
+}
+
+bool cppiper::Reactor::modify(int loop, int fd, uint32_t events,
+                              ReactorHandler *handler) {
+  epoll_event event{};
+  event.events = events;
+  event.data.ptr = handler;
+  if (epoll_ctl(loops[loop]->epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+    LOG(ERROR) << "Failed to modify descriptor " << fd << " on reactor, "
+               << errno;
+    return false;
+  }
+  return true;
+}
+
+void cppiper::Reactor::detach(int loop, int fd) {
+  run_sync(loop, [this, loop, fd]() {
+    if (epoll_ctl(loops[loop]->epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1)
+      LOG(ERROR) << "Failed to detach descriptor " << fd << " from reactor, "
+                 << errno;
+  });
+  DEBUG_LOG << "Detached descriptor " << fd << " from reactor loop " << loop;
+}
+
+void cppiper::Reactor::post(int loop, std::function<void()> task) {
+  Loop &target(*loops[loop]);
+  bool wake;
+  {
+    std::lock_guard lk(target.lock);
+    wake = target.tasks.empty();
+    target.tasks.emplace_back(std::move(task));
+  }
+  if (not wake)
+    return;
+  const uint64_t value(1);
+  if (write(target.event_fd, &value, sizeof(value)) < 0)
+    LOG(ERROR) << "Failed to wake reactor loop " << loop << ", " << errno;
+}
+
+void cppiper::Reactor::run_sync(int loop, std::function<void()> task) {
+  if (std::this_thread::get_id() == loops[loop]->thread.get_id()) {
+    task();
+    return;
+  }
+  std::promise<void> done;
+  std::future<void> finished(done.get_future());
+  post(loop, [&]() {
+    task();
+    done.set_value();
+  });
+  finished.wait();
+}
+
+cppiper::ReactorTimer
+cppiper::Reactor::add_timer(int loop,
+                            std::chrono::steady_clock::time_point deadline,
+                            std::function<void()> task) {
+  Loop &target(*loops[loop]);
+  const ReactorTimer timer{loop, deadline, next_timer++};
+  bool earliest;
+  {
+    std::lock_guard lk(target.lock);
+    const auto entry(target.timers.emplace(
+        std::make_pair(deadline, timer.id), std::move(task)));
+    earliest = entry.first == target.timers.begin();
+    target.timer_count = target.timers.size();
+  }
+  // The loop computes its wait from the earliest timer, so it must wake to
+  // wait for a shorter one.
+  if (not earliest or std::this_thread::get_id() == target.thread.get_id())
+    return timer;
+  const uint64_t value(1);
+  if (write(target.event_fd, &value, sizeof(value)) < 0)
+    LOG(ERROR) << "Failed to wake reactor loop " << loop << ", " << errno;
+  return timer;
+}
+
+bool cppiper::Reactor::cancel_timer(const ReactorTimer &timer) {
+  if (timer.loop < 0 or static_cast<size_t>(timer.loop) >= loops.size())
+    return false;
+  Loop &target(*loops[timer.loop]);
+  std::lock_guard lk(target.lock);
+  const bool cancelled(target.timers.erase({timer.deadline, timer.id}) > 0);
+  target.timer_count = target.timers.size();
+  return cancelled;
+}
+
+size_t cppiper::Reactor::get_loop_count(void) const { return loops.size(); }
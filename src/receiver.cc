@@ -1,5 +1,13 @@
 #include "../include/receiver.hh"
 #include "cppiperconfig.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
@@ -7,120 +15,945 @@
 #include <glog/logging.h>
 #include <iostream>
 #include <istream>
-#include <mutex>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <thread>
 #include <tuple>
 #include <unistd.h>
 #include <vector>
 
-void cppiper::Receiver::run() {
-  running = true;
+namespace {
+
+//! Delay between attempts to wake a blocking open that has not started yet.
+const std::chrono::milliseconds EXPIRE_RETRY(1);
+
+} // namespace
+
+bool cppiper::Receiver::decode(void) {
   while (true) {
-    DLOG(INFO) << "Reading message size bytes from pipe " << pipepath.filename() << "...";
-    char hexbuffer[8];
-    int total_bytes_read(0);
-    int bytes_read;
-    while ((bytes_read =
-                read(pipe_fd, hexbuffer + total_bytes_read,
-                     std::min(8 - total_bytes_read, buffering_limit))) > 0 and
-           (8 - (total_bytes_read += bytes_read) > 0)) {
-      if (bytes_read < 0) {
-        LOG(ERROR) << "Failed to read size bytes from pipe " << pipepath.filename() << ", "
-                   << errno;
-        statuscode = errno;
+    if (body_pending) {
+      const size_t body_bytes(std::min(read_tail - read_head,
+                                       pending_header.length - pending_filled));
+      if (sink_fd != -1) {
+        if (not write_sink(read_buffer.get() + read_head, body_bytes))
+          return false;
+      } else if (body_bytes > 0) {
+        std::memcpy(pending.data() + pending_filled,
+                    read_buffer.get() + read_head, body_bytes);
+      }
+      read_head += body_bytes;
+      pending_filled += body_bytes;
+      if (pending_filled < pending_header.length)
+        return true;
+      body_pending = false;
+      if (sink_fd != -1) {
+        TRACE_LOG << "Spliced " << pending_header.length
+                  << " byte message from pipe " << pipepath.filename();
+        sink_fd = -1;
+        counters.count_messages();
+        TRACE_EVENT(FRAME_RECEIVED, counters.get_id(), pending_header.length);
         continue;
-      } else if (bytes_read == 0) {
-        DLOG(INFO) << "Breaking from receiver loop for pipe " << pipepath.filename();
-        break;
       }
-    };
-    statuscode = 0;
-    std::stringstream ss;
-    ss << std::hex << hexbuffer;
-    int msg_size;
-    ss >> msg_size;
-    if (msg_size < 1) {
-      LOG(ERROR) << "Parsed message size less than 1 (" << msg_size
-                 << ") from pipe " << pipepath.filename() << ", " << errno;
-      statuscode = errno;
+      deliver();
       continue;
     }
-    char subbuffer[msg_size];
-    DLOG(INFO) << "Reading message bytes from pipe " << pipepath.filename() << "...";
-    total_bytes_read = 0;
-    while ((bytes_read = read(
-                pipe_fd, subbuffer + total_bytes_read,
-                std::min(msg_size - total_bytes_read, buffering_limit))) > 0 and
-           (msg_size - (total_bytes_read += bytes_read) > 0))
-      ;
-    if (bytes_read == -1) {
-      LOG(ERROR) << "Failed to read message bytes from pipe " << pipepath.filename()
+    const size_t available(read_tail - read_head);
+    if (available < HEX_HEADER_SIZE)
+      return true;
+    const char *header_buffer(read_buffer.get() + read_head);
+    pending_header = FrameHeader{};
+    if (static_cast<uint8_t>(header_buffer[0]) == FRAME_MAGIC) {
+      if (available < FRAME_HEADER_SIZE)
+        return true;
+      decode_header(header_buffer, pending_header);
+      if (pending_header.version != FRAME_VERSION) {
+        LOG(ERROR) << "Unsupported wire format version "
+                   << +pending_header.version << " on pipe "
+                   << pipepath.filename();
+        statuscode = EPROTO;
+        return false;
+      }
+      const size_t header_size(FRAME_HEADER_SIZE +
+                               extensions_size(pending_header.flags));
+      if (available < header_size)
+        return true;
+      decode_extensions(pending_header.flags,
+                        header_buffer + FRAME_HEADER_SIZE, pending_extensions);
+      read_head += header_size;
+    } else if (decode_hex_header(header_buffer, pending_header.length)) {
+      read_head += HEX_HEADER_SIZE;
+    } else {
+      LOG(ERROR) << "Failed to parse message header from pipe "
+                 << pipepath.filename();
+      statuscode = EPROTO;
+      return false;
+    }
+    if (pending_header.length > options.max_message_size) {
+      LOG(ERROR) << "Message of " << pending_header.length
+                 << " bytes exceeds the maximum message size on pipe "
+                 << pipepath.filename();
+      statuscode = EPROTO;
+      return false;
+    }
+    chunk_sizer.observe(FRAME_HEADER_SIZE + pending_header.length);
+    pending_filled = 0;
+    body_pending = true;
+    if (options.sink and not(pending_header.flags & FLAG_COMPRESSED) and
+        pending_header.length >= options.splice_threshold and
+        (sink_fd = options.sink(pending_header.length)) != -1)
+      continue;
+    pending = pool->acquire(pending_header.length);
+  }
+}
+
+bool cppiper::Receiver::write_sink(const char *data, size_t len) {
+  while (len > 0) {
+    const ssize_t bytes_written(write(sink_fd, data, len));
+    if (bytes_written < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG(ERROR) << "Failed to write message body from pipe "
+                 << pipepath.filename() << " to descriptor " << sink_fd
                  << ", " << errno;
       statuscode = errno;
-      continue;
-    } else if (bytes_read == 0) {
-      DLOG(INFO) << "Breaking from receiver loop for pipe " << pipepath.filename();
+      return false;
+    }
+    data += bytes_written;
+    len -= bytes_written;
+  }
+  return true;
+}
+
+bool cppiper::Receiver::decompress(void) {
+  const uint64_t raw_length(pending_extensions.raw_length);
+  if (raw_length > options.max_message_size or
+      raw_length > pending.size() * COMPRESS_MAX_RATIO + 16)
+    return false;
+  const auto start(std::chrono::steady_clock::now());
+  Message raw(pool->acquire(raw_length));
+  if (not decompress_block(pending.data(), pending.size(), raw.data(),
+                           raw_length))
+    return false;
+  const auto elapsed(std::chrono::steady_clock::now() - start);
+  {
+    std::lock_guard lk(stats_lock);
+    decompression_stats.frames++;
+    decompression_stats.raw_bytes += raw_length;
+    decompression_stats.compressed_bytes += pending.size();
+    decompression_stats.nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  }
+  pending = std::move(raw);
+  return true;
+}
+
+void cppiper::Receiver::deliver(void) {
+  counters.count_messages();
+  if (pending_header.flags & ~FRAME_KNOWN_FLAGS) {
+    LOG(ERROR) << "Dropping message with unsupported flags "
+               << pending_header.flags << " from pipe " << pipepath.filename();
+    statuscode = EPROTO;
+    return;
+  }
+  if ((pending_header.flags & FLAG_CHECKSUM) and
+      crc32c(pending.data(), pending.size()) != pending_header.checksum) {
+    LOG(ERROR) << "Dropping message with bad checksum from pipe "
+               << pipepath.filename();
+    statuscode = EBADMSG;
+    return;
+  }
+  if ((pending_header.flags & FLAG_COMPRESSED) and not decompress()) {
+    LOG(ERROR) << "Dropping message with corrupt compressed payload from pipe "
+               << pipepath.filename();
+    statuscode = EBADMSG;
+    return;
+  }
+  statuscode = 0;
+  TRACE_EVENT(FRAME_RECEIVED, counters.get_id(), pending.size());
+  pending.tag =
+      pending_header.flags & FLAG_TYPED ? pending_extensions.type_tag : 0;
+  pending.correlation = pending_header.flags & FLAG_CORRELATED
+                            ? pending_extensions.correlation_id
+                            : 0;
+  if (handler and options.dispatch_threads == 0) {
+    Message msg(std::move(pending));
+    handle(msg);
+    return;
+  }
+  decoded.emplace_back(std::move(pending));
+}
+
+void cppiper::Receiver::handle(const Message &msg) {
+  try {
+    handler(msg);
+  } catch (const std::exception &e) {
+    LOG(ERROR) << "Message handler on receiver instance " << name
+               << " threw: " << e.what();
+  } catch (...) {
+    LOG(ERROR) << "Message handler on receiver instance " << name
+               << " threw a non-standard exception";
+  }
+}
+
+void cppiper::Receiver::dispatch(void) {
+  Message msg;
+  while (pop(msg, std::chrono::nanoseconds::max())) {
+    notify_producer();
+    handle(msg);
+    msg = Message();
+  }
+}
+
+ssize_t cppiper::Receiver::read_stream(char *dest, size_t len) {
+  if (not ring) {
+    const ssize_t bytes_read(read(pipe_fd, dest, len));
+    counters.count_syscall(bytes_read, len);
+    return bytes_read;
+  }
+  while (true) {
+    size_t bytes_read(ring->read(dest, len));
+    if (bytes_read == 0) {
+      ring->prepare_read_wait();
+      bytes_read = ring->read(dest, len);
+    }
+    if (bytes_read > 0) {
+      ring->notify_space();
+      return bytes_read;
+    }
+    char wakeups[64];
+    const ssize_t woken(read(pipe_fd, wakeups, sizeof(wakeups)));
+    counters.count_syscall(woken, 0);
+    if (woken == 0 and (bytes_read = ring->read(dest, len)) > 0) {
+      ring->notify_space();
+      return bytes_read;
+    }
+    if (woken < 0 and errno == EAGAIN)
+      ring_idle = true;
+    if (woken <= 0)
+      return woken;
+  }
+}
+
+void cppiper::Receiver::wait_readable(void) {
+  if (idle_spinner.spin())
+    return;
+  TRACE_LOG << "Waiting on pipe " << pipepath.filename() << "...";
+  pollfd pfd{pipe_fd, POLLIN, 0};
+  poll(&pfd, 1, -1);
+  idle_spinner.reset();
+}
+
+bool cppiper::Receiver::fill(void) {
+  if (read_head == read_tail) {
+    read_head = read_tail = 0;
+  } else if (read_head > 0) {
+    std::memmove(read_buffer.get(), read_buffer.get() + read_head,
+                 read_tail - read_head);
+    read_tail -= read_head;
+    read_head = 0;
+  }
+  const size_t chunk_size(chunk_sizer.get());
+  if (chunk_size != read_capacity and read_tail < chunk_size) {
+    DEBUG_LOG << "Resizing read buffer of pipe " << pipepath.filename()
+              << " to " << chunk_size << " bytes";
+    std::unique_ptr<char[]> resized(new char[chunk_size]);
+    std::memcpy(resized.get(), read_buffer.get(), read_tail);
+    read_buffer = std::move(resized);
+    read_capacity = chunk_size;
+  }
+  ssize_t bytes_read;
+  const size_t body_remaining(body_pending ? pending_header.length - pending_filled
+                                           : 0);
+  if (sink_fd != -1 and not ring and read_head == read_tail) {
+    TRACE_LOG << "Splicing message bytes from pipe " << pipepath.filename()
+              << "...";
+    const bool nonblocking(reactor or
+                           options.wait_strategy != WaitStrategy::PARK);
+    bytes_read = splice(pipe_fd, nullptr, sink_fd, nullptr, body_remaining,
+                        SPLICE_F_MOVE | (nonblocking ? SPLICE_F_NONBLOCK : 0));
+    counters.count_syscall(bytes_read, body_remaining);
+    if (bytes_read > 0)
+      pending_filled += bytes_read;
+  } else if (body_remaining >= read_capacity and
+             sink_fd == -1) {
+    TRACE_LOG << "Reading message bytes from pipe " << pipepath.filename()
+              << "...";
+    bytes_read = read_stream(pending.data() + pending_filled, body_remaining);
+    if (bytes_read > 0)
+      pending_filled += bytes_read;
+  } else {
+    TRACE_LOG << "Reading from pipe " << pipepath.filename() << "...";
+    bytes_read =
+        read_stream(read_buffer.get() + read_tail, read_capacity - read_tail);
+    if (bytes_read > 0)
+      read_tail += bytes_read;
+  }
+  if (bytes_read < 0) {
+    if (errno == EINTR)
+      return true;
+    if (errno == EAGAIN) {
+      if (not reactor)
+        wait_readable();
+      return true;
+    }
+    LOG(ERROR) << "Failed to read bytes from pipe " << pipepath.filename()
+               << ", " << errno;
+    statuscode = errno;
+    return false;
+  } else if (bytes_read == 0) {
+    if (body_pending or read_head != read_tail)
+      LOG(WARNING) << "Pipe " << pipepath.filename()
+                   << " closed in the middle of a message";
+    DEBUG_LOG << "Reached end of pipe " << pipepath.filename();
+    return false;
+  }
+  idle_spinner.reset();
+  counters.count_bytes(bytes_read);
+  TRACE_EVENT(READ, counters.get_id(), bytes_read);
+  const bool decodable(decode());
+  const bool queued(queue_decoded());
+  if (not update_throttle() or not queued)
+    wait_for_room();
+  return decodable;
+}
+
+bool cppiper::Receiver::push(Message &msg) {
+  const size_t size(msg.size());
+  const auto try_push = [&]() {
+    queued_msg_count++;
+    queued_byte_count += size;
+    if (spsc_queue ? spsc_queue->try_push(msg) : mpmc_queue->try_push(msg))
+      return true;
+    queued_msg_count--;
+    queued_byte_count -= size;
+    return false;
+  };
+  while (not try_push()) {
+    if (reactor)
+      return false;
+    DEBUG_LOG << "Message queue full on receiver instance " << name
+              << ", waiting...";
+    consumer_event.notify_all();
+    const uint32_t key(producer_event.prepare_wait());
+    if (try_push()) {
+      producer_event.cancel_wait();
       break;
     }
-    std::lock_guard lk(queue_lock);
-    msg_queue.emplace(std::string(subbuffer, msg_size));
-    queue_condition.notify_one();
+    const auto wait_start(std::chrono::steady_clock::now());
+    producer_event.commit_wait(key);
+    counters.count_blocked(std::chrono::steady_clock::now() - wait_start);
+  }
+  counters.observe_depth(queued_msg_count);
+  return true;
+}
+
+bool cppiper::Receiver::queue_decoded(void) {
+  const size_t first(decoded_index);
+  while (decoded_index < decoded.size() and push(decoded[decoded_index]))
+    decoded_index++;
+  if (decoded_index > first) {
+    consumer_event.notify_all();
+    if (async_waiting) {
+      std::lock_guard lk(async_lock);
+      serve_receives();
+    }
   }
-  std::lock_guard lk(queue_lock);
+  if (decoded_index < decoded.size())
+    return false;
+  decoded.clear();
+  decoded_index = 0;
+  return true;
+}
+
+bool cppiper::Receiver::above_high_watermark(void) const {
+  return queued_msg_count >= high_watermark or
+         (high_watermark_bytes > 0 and
+          queued_byte_count >= high_watermark_bytes);
+}
+
+bool cppiper::Receiver::below_low_watermark(void) const {
+  return queued_msg_count <= low_watermark and
+         (high_watermark_bytes == 0 or
+          queued_byte_count <= low_watermark_bytes);
+}
+
+bool cppiper::Receiver::update_throttle(void) {
+  if (not throttled and above_high_watermark()) {
+    DEBUG_LOG << "Receive queue of receiver instance " << name
+              << " reached its high watermark";
+    throttled = true;
+    if (options.on_high_watermark)
+      options.on_high_watermark(queued_msg_count, queued_byte_count);
+  } else if (throttled and below_low_watermark()) {
+    DEBUG_LOG << "Receive queue of receiver instance " << name
+              << " drained to its low watermark";
+    throttled = false;
+    if (options.on_low_watermark)
+      options.on_low_watermark(queued_msg_count, queued_byte_count);
+  }
+  return not throttled;
+}
+
+void cppiper::Receiver::wait_for_room(void) {
+  if (reactor) {
+    pause();
+    return;
+  }
+  DEBUG_LOG << "Receive queue of receiver instance " << name
+            << " is full, waiting...";
+  consumer_event.notify_all();
+  TRACE_EVENT(RECEIVE_PAUSED, counters.get_id(), queued_msg_count);
+  const auto wait_start(std::chrono::steady_clock::now());
+  while (not update_throttle()) {
+    const uint32_t key(producer_event.prepare_wait());
+    if (below_low_watermark()) {
+      producer_event.cancel_wait();
+      continue;
+    }
+    producer_event.commit_wait(key);
+  }
+  counters.count_blocked(std::chrono::steady_clock::now() - wait_start);
+  TRACE_EVENT(RECEIVE_RESUMED, counters.get_id(), queued_msg_count);
+}
+
+void cppiper::Receiver::notify_producer(void) {
+  if (not reactor) {
+    if (not throttled or below_low_watermark())
+      producer_event.notify_one();
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (paused.load(std::memory_order_relaxed) and below_low_watermark() and
+      not resume_pending.exchange(true))
+    reactor->post(loop, [this]() {
+      resume_pending = false;
+      if (resume() and ring)
+        handle_events(EPOLLIN);
+    });
+}
+
+void cppiper::Receiver::pause(void) {
+  DEBUG_LOG << "Message queue full on receiver instance " << name
+            << ", pausing reads...";
+  paused = true;
+  pause_start = std::chrono::steady_clock::now();
+  TRACE_EVENT(RECEIVE_PAUSED, counters.get_id(), queued_msg_count);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  reactor->modify(loop, pipe_fd, EPOLLET, this);
+  resume();
+}
+
+bool cppiper::Receiver::resume(void) {
+  if (not paused)
+    return false;
+  const bool queued(queue_decoded());
+  if (not update_throttle() or not queued)
+    return false;
+  DEBUG_LOG << "Resuming reads on receiver instance " << name;
+  paused = false;
+  counters.count_blocked(std::chrono::steady_clock::now() - pause_start);
+  TRACE_EVENT(RECEIVE_RESUMED, counters.get_id(), queued_msg_count);
+  reactor->modify(loop, pipe_fd, EPOLLIN, this);
+  return true;
+}
+
+void cppiper::Receiver::finish(void) {
+  DEBUG_LOG << "Breaking from receiver loop for pipe " << pipepath.filename();
+  if (reactor and pipe_open)
+    reactor->detach(loop, pipe_fd);
   running = false;
-  queue_condition.notify_all();
+  consumer_event.notify_all();
+  std::lock_guard lk(async_lock);
+  serve_receives();
 }
 
-cppiper::Receiver::Receiver(const std::string name,
-                            const std::filesystem::path pipepath)
-    : name(name), pipepath(pipepath), buffering_limit(65536), running(false),
-      statuscode(0), pipe_fd(-1), msg_queue{}, queue_lock{}, queue_condition{} {
-  DLOG(INFO) << "Initialising receiver thread for pipe " << pipepath.filename();
-  DLOG(INFO) << "Opening receiver end of pipe " << pipepath.filename() << "...";
-  pipe_fd = open(pipepath.c_str(), O_RDONLY);
-  if (pipe_fd == -1) {
-    LOG(ERROR) << "Failed to open receiver pipe " << pipepath << ", " << errno;
+void cppiper::Receiver::handle_events(uint32_t) {
+  // Ring data does not make the pipe readable, so keep reading until the ring
+  // runs dry and the receiver has asked the sender for a wakeup.
+  ring_idle = false;
+  while (not paused) {
+    if (not fill()) {
+      finish();
+      return;
+    }
+    if (not ring or ring_idle)
+      return;
+  }
+}
+
+bool cppiper::Receiver::try_pop(Message &msg) {
+  if (not(spsc_queue ? spsc_queue->try_pop(msg) : mpmc_queue->try_pop(msg)))
+    return false;
+  queued_msg_count--;
+  queued_byte_count -= msg.size();
+  TRACE_EVENT(MESSAGE_TAKEN, counters.get_id(), msg.size());
+  return true;
+}
+
+bool cppiper::Receiver::pop(Message &msg, std::chrono::nanoseconds timeout) {
+  const bool forever(timeout == std::chrono::nanoseconds::max());
+  const auto deadline(deadline_after(timeout));
+  SpinWait spinner(options.wait_strategy, options.spin_budget);
+  while (not try_pop(msg)) {
+    const auto remaining(deadline - std::chrono::steady_clock::now());
+    if (not running or remaining <= std::chrono::nanoseconds::zero()) {
+      if (try_pop(msg))
+        break;
+      return false;
+    }
+    if (spinner.spin())
+      continue;
+    const uint32_t key(consumer_event.prepare_wait());
+    if (try_pop(msg)) {
+      consumer_event.cancel_wait();
+      break;
+    }
+    if (not running) {
+      consumer_event.cancel_wait();
+      continue;
+    }
+    if (forever)
+      consumer_event.commit_wait(key);
+    else
+      consumer_event.commit_wait(key, remaining);
+  }
+  return true;
+}
+
+void cppiper::Receiver::run() {
+  while (fill())
+    ;
+  finish();
+}
+
+void cppiper::Receiver::run_connect(void) {
+  DEBUG_LOG << "Waiting for a sender on pipe " << pipepath.filename() << "...";
+  // Returns once a sender opens the write end, or once expire_connect()
+  // opens it itself.
+  int fd(-1);
+  int error(ETIMEDOUT);
+  while (connect_state == CONNECTING) {
+    fd = open(pipepath.c_str(), O_RDONLY);
+    if (fd != -1 or errno != EINTR) {
+      error = errno;
+      break;
+    }
+  }
+  open_returned = true;
+  int expected(CONNECTING);
+  if (fd != -1 and
+      not connect_state.compare_exchange_strong(expected, CONNECTED)) {
+    close(fd);
+    fd = -1;
+    error = ETIMEDOUT;
+  }
+  if (fd == -1) {
+    if (error == ETIMEDOUT)
+      LOG(ERROR) << "Timed out waiting for a sender on pipe "
+                 << pipepath.filename();
+    else
+      LOG(ERROR) << "Failed to open receiver pipe " << pipepath << ", "
+                 << error;
+    statuscode = error;
+    connect_promise.set_value(false);
+    finish();
+    return;
+  }
+  pipe_fd = fd;
+  if (not connect()) {
+    close(pipe_fd);
+    pipe_fd = -1;
+    connect_promise.set_value(false);
+    finish();
+    return;
+  }
+  DEBUG_LOG << "Sender connected to pipe " << pipepath.filename();
+  connect_promise.set_value(true);
+  if (not reactor)
+    run();
+}
+
+bool cppiper::Receiver::connect(void) {
+  const size_t capacity(
+      tune_pipe_capacity(pipe_fd, options.pipe_capacity, pipepath));
+  if (options.transport == Transport::SHARED_MEMORY) {
+    DEBUG_LOG << "Mapping shared memory ring for pipe " << pipepath.filename()
+              << "...";
+    ring = std::make_unique<ShmRing>();
+    if (not ring->open(pipepath)) {
+      statuscode = errno;
+      ring.reset();
+      return false;
+    }
+  }
+  chunk_sizer.set_limit(ring ? ring->get_capacity() / 2
+                             : capacity > 0 ? capacity : CHUNK_SIZE_DEFAULT);
+  // The receiver thread reads with blocking calls unless it spins, the
+  // reactor with non-blocking ones.
+  const bool nonblocking(reactor or
+                         options.wait_strategy != WaitStrategy::PARK);
+  const int flags(fcntl(pipe_fd, F_GETFL));
+  if (flags == -1 or
+      fcntl(pipe_fd, F_SETFL,
+            nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == -1) {
+    LOG(ERROR) << "Failed to set the blocking mode of receiver pipe "
+               << pipepath << ", " << errno;
     statuscode = errno;
+    return false;
+  }
+  // Set before attaching, so a stream ending on the first event detaches.
+  pipe_open = true;
+  if (reactor) {
+    DEBUG_LOG << "Attaching receiver end of pipe " << pipepath.filename()
+              << " to reactor...";
+    if (not reactor->attach(loop, pipe_fd, EPOLLIN, this)) {
+      LOG(ERROR) << "Failed to attach receiver pipe " << pipepath
+                 << " to reactor, " << errno;
+      statuscode = errno;
+      pipe_open = false;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool cppiper::Receiver::expire_connect(void) {
+  int expected(CONNECTING);
+  if (not connect_state.compare_exchange_strong(expected, EXPIRED) and
+      expected == CONNECTED)
+    return true;
+  if (open_returned)
+    return true;
+  // Fails with ENXIO until the blocking open has registered as a reader.
+  const int fd(open(pipepath.c_str(), O_WRONLY | O_NONBLOCK));
+  if (fd == -1)
+    return false;
+  close(fd);
+  return true;
+}
+
+void cppiper::Receiver::watch_connect(void) {
+  if (connect_future.wait_for(options.connect_timeout) ==
+      std::future_status::ready)
     return;
+  while (not expire_connect())
+    std::this_thread::sleep_for(EXPIRE_RETRY);
+}
+
+cppiper::Receiver::Receiver(const std::string name,
+                            const std::filesystem::path pipepath,
+                            const ReceiverOptions &options)
+    : Receiver(name, pipepath, MessageHandler(), options) {}
+
+cppiper::Receiver::Receiver(const std::string name,
+                            const std::filesystem::path pipepath,
+                            MessageHandler handler,
+                            const ReceiverOptions &options)
+    : name(name), pipepath(pipepath), options(options),
+      handler(std::move(handler)), chunk_sizer(options.chunk_size),
+      reactor(options.reactor), loop(-1), running(false),
+      statuscode(0), pipe_fd(-1), pipe_open(false), connect_promise(),
+      connect_future(connect_promise.get_future().share()),
+      connect_state(CONNECTING), open_returned(false), ring(),
+      ring_idle(false),
+      idle_spinner(options.wait_strategy, options.spin_budget),
+      pool(std::make_shared<BufferPool>()),
+      read_buffer(new char[chunk_sizer.get()]),
+      read_capacity(chunk_sizer.get()), read_head(0), read_tail(0),
+      pending_header{}, pending_extensions{}, pending{}, pending_filled(0),
+      body_pending(false), sink_fd(-1), decoded{}, decoded_index(0),
+      high_watermark(std::min(options.high_watermark > 0
+                                  ? options.high_watermark
+                                  : options.queue_capacity,
+                              options.queue_capacity)),
+      low_watermark(std::min(options.low_watermark > 0 ? options.low_watermark
+                                                       : high_watermark / 2,
+                             high_watermark - 1)),
+      high_watermark_bytes(options.high_watermark_bytes),
+      low_watermark_bytes(options.low_watermark_bytes > 0
+                              ? options.low_watermark_bytes
+                              : high_watermark_bytes / 2),
+      queued_msg_count(0), queued_byte_count(0), throttled(false),
+      paused(false), pause_start(), resume_pending(false), counters(),
+      decompression_stats{}, stats_lock{}, spsc_queue(), mpmc_queue(),
+      consumer_event(), producer_event(), workers(), async_lock(),
+      async_receives(), async_waiting(false) {
+  MetricsRegistry::instance().add(this);
+  if (options.shared_consumers or
+      (this->handler and options.dispatch_threads > 0))
+    mpmc_queue = std::make_unique<MPMCQueue<Message>>(options.queue_capacity);
+  else
+    spsc_queue = std::make_unique<SPSCQueue<Message>>(options.queue_capacity);
+  DEBUG_LOG << "Initialising receiver thread for pipe " << pipepath.filename();
+  const bool bounded(options.async_connect or
+                     options.connect_timeout.count() > 0);
+  if (reactor)
+    loop = reactor->choose_loop();
+  running = true;
+  if (bounded) {
+    DEBUG_LOG << "Connecting receiver end of pipe " << pipepath.filename()
+              << " in the background...";
+    thread = std::thread(&Receiver::run_connect, this);
+    if (options.connect_timeout.count() > 0)
+      connect_watchdog = std::thread(&Receiver::watch_connect, this);
+  } else {
+    DEBUG_LOG << "Opening receiver end of pipe " << pipepath.filename()
+              << "...";
+    pipe_fd = open(pipepath.c_str(), O_RDONLY);
+    if (pipe_fd == -1) {
+      LOG(ERROR) << "Failed to open receiver pipe " << pipepath << ", "
+                 << errno;
+      statuscode = errno;
+      running = false;
+      connect_promise.set_value(false);
+      return;
+    }
+    if (not connect()) {
+      running = false;
+      close(pipe_fd);
+      pipe_fd = -1;
+      connect_promise.set_value(false);
+      return;
+    }
+    connect_promise.set_value(true);
+    if (not reactor)
+      thread = std::thread(&Receiver::run, this);
   }
-  thread = std::thread(&Receiver::run, this);
+  // A receiver connecting in the background runs its loop on the connecting
+  // thread.
+  if (thread.joinable() and not reactor)
+    apply_thread_options(thread.native_handle(), options.thread_options,
+                         name);
+  if (this->handler)
+    for (size_t i = 0; i < options.dispatch_threads; i++)
+      workers.emplace_back(&Receiver::dispatch, this);
+  if (bounded and not options.async_connect)
+    connect_future.wait();
   LOG(INFO) << "Constructed receiver instance " << name << " with pipe "
             << this->pipepath.filename();
 }
 
-std::optional<const std::string> cppiper::Receiver::receive(bool wait) {
-  std::unique_lock lk(queue_lock);
-  LOG(INFO) << "Retrieving message from receiver instance " << name;
-  if (msg_queue.empty() and running and wait) {
-    queue_condition.wait(lk, [this] { return not msg_queue.empty() or not running; });
+cppiper::Receiver::~Receiver(void) {
+  MetricsRegistry::instance().remove(this);
+}
+
+int cppiper::Receiver::get_status_code(void) const { return statuscode; }
+
+std::shared_future<bool> cppiper::Receiver::connected(void) const {
+  return connect_future;
+}
+
+std::optional<cppiper::Message> cppiper::Receiver::receive(bool wait) {
+  return receive(wait ? std::chrono::nanoseconds::max()
+                      : std::chrono::nanoseconds::zero());
+}
+
+std::optional<cppiper::Message>
+cppiper::Receiver::receive(std::chrono::steady_clock::time_point deadline) {
+  if (deadline == std::chrono::steady_clock::time_point::max())
+    return receive(std::chrono::nanoseconds::max());
+  return receive(std::max<std::chrono::nanoseconds>(
+      deadline - std::chrono::steady_clock::now(),
+      std::chrono::nanoseconds::zero()));
+}
+
+std::optional<cppiper::Message>
+cppiper::Receiver::receive(std::chrono::nanoseconds timeout) {
+  TRACE_LOG << "Retrieving message from receiver instance " << name;
+  Message msg;
+  if (not pop(msg, timeout)) {
+    TRACE_LOG << "No message to retrieve from receiver instance " << name;
+    return {};
   }
-  if (msg_queue.empty()) {
-    LOG(INFO) << "No message to retrieve from receiver instance " << name;
+  notify_producer();
+  TRACE_LOG << "Retrieved message from receiver instance " << name;
+  return std::optional<Message>(std::move(msg));
+}
+
+void cppiper::Receiver::serve_receives(void) {
+  using Completion =
+      std::pair<std::shared_ptr<AsyncReceive>, std::optional<Message>>;
+  auto completions(std::make_shared<std::vector<Completion>>());
+  bool taken(false);
+  while (not async_receives.empty()) {
+    const std::shared_ptr<AsyncReceive> &waiter(async_receives.front());
+    std::unique_lock lk(waiter->lock);
+    if (not waiter->done) {
+      // The waiter lock keeps the deadline from completing the receive once
+      // it has taken a message.
+      Message msg;
+      if (try_pop(msg)) {
+        taken = true;
+        completions->emplace_back(waiter, std::move(msg));
+      } else if (not running) {
+        completions->emplace_back(waiter, std::nullopt);
+      } else {
+        break;
+      }
+      waiter->done = true;
+      reactor->cancel_timer(waiter->timer);
+    }
     lk.unlock();
-    return {};
+    async_receives.pop_front();
+  }
+  async_waiting = not async_receives.empty();
+  if (taken)
+    notify_producer();
+  if (completions->empty())
+    return;
+  reactor->post(loop, [completions]() {
+    for (Completion &completion : *completions)
+      completion.first->callback(std::move(completion.second));
+  });
+}
+
+void cppiper::Receiver::receive_async(
+    ReceiveCallback callback, std::chrono::steady_clock::time_point deadline) {
+  if (not reactor or loop == -1) {
+    LOG(ERROR) << "Receiver instance " << name
+               << " needs a reactor to receive asynchronously";
+    callback(std::nullopt);
+    return;
+  }
+  std::unique_lock lk(async_lock);
+  Message msg;
+  if (async_receives.empty() and try_pop(msg)) {
+    lk.unlock();
+    notify_producer();
+    callback(std::move(msg));
+    return;
+  }
+  auto waiter(std::make_shared<AsyncReceive>());
+  waiter->callback = std::move(callback);
+  if (deadline != std::chrono::steady_clock::time_point::max())
+    waiter->timer = reactor->add_timer(loop, deadline, [waiter]() {
+      {
+        std::lock_guard wlk(waiter->lock);
+        if (waiter->done)
+          return;
+        waiter->done = true;
+      }
+      waiter->callback(std::nullopt);
+    });
+  async_receives.push_back(std::move(waiter));
+  async_waiting = true;
+  // The loop may have queued a message, or ended the stream, before it could
+  // see this receive waiting.
+  if (queued_msg_count > 0 or not running)
+    serve_receives();
+}
+
+void cppiper::Receiver::reject_type(const Message &msg, uint64_t type_tag,
+                                    size_t size) const {
+  LOG(ERROR) << "Dropping message of " << msg.size() << " bytes with type tag "
+             << std::hex << msg.type_tag() << " from pipe "
+             << pipepath.filename() << ", expected " << size
+             << " bytes with type tag " << type_tag << std::dec;
+}
+
+size_t cppiper::Receiver::receive_many(std::vector<Message> &out, size_t max,
+                                       std::chrono::nanoseconds timeout) {
+  TRACE_LOG << "Retrieving up to " << max
+            << " messages from receiver instance " << name;
+  if (max == 0)
+    return 0;
+  Message msg;
+  if (not pop(msg, timeout))
+    return 0;
+  out.emplace_back(std::move(msg));
+  size_t count(1);
+  while (count < max and try_pop(msg)) {
+    out.emplace_back(std::move(msg));
+    count++;
   }
-  const std::string msg = msg_queue.front();
-  msg_queue.pop();
-  lk.unlock();
-  LOG(INFO) << "Retrieved message from receiver instance " << name;
-  return msg;
+  notify_producer();
+  TRACE_LOG << "Retrieved " << count << " messages from receiver instance "
+            << name;
+  return count;
+}
+
+size_t cppiper::Receiver::drain(std::vector<Message> &out) {
+  return receive_many(out, SIZE_MAX);
+}
+
+size_t cppiper::Receiver::queue_size(void) const { return queued_msg_count; }
+
+size_t cppiper::Receiver::queued_bytes(void) const {
+  return queued_byte_count;
+}
+
+uint64_t cppiper::Receiver::get_msg_count(void) const {
+  return counters.get_messages();
+}
+
+size_t cppiper::Receiver::get_pipe_capacity(void) const {
+  const int capacity(not pipe_open ? -1 : fcntl(pipe_fd, F_GETPIPE_SZ));
+  return capacity == -1 ? 0 : capacity;
+}
+
+size_t cppiper::Receiver::get_chunk_size(void) const {
+  return chunk_sizer.get();
+}
+
+cppiper::CompressionStats
+cppiper::Receiver::get_decompression_stats(void) const {
+  std::lock_guard lk(stats_lock);
+  return decompression_stats;
+}
+
+uint64_t cppiper::Receiver::get_read_count(void) const {
+  return counters.get_syscalls();
+}
+
+cppiper::EndpointStats cppiper::Receiver::stats(void) const {
+  EndpointStats stats;
+  stats.name = name;
+  stats.pipe = pipepath;
+  stats.role = EndpointRole::RECEIVER;
+  stats.status_code = statuscode;
+  counters.snapshot(stats);
+  stats.queue_depth = queued_msg_count;
+  return stats;
 }
 
 bool cppiper::Receiver::wait(void) {
-  if (not thread.joinable()) {
-    return true;
+  // In reactor mode the thread only connects, and is done once the pipe is
+  // open or the connect failed.
+  if (thread.joinable()) {
+    DEBUG_LOG << "Joining thread for receiver instance " << name << "...";
+    thread.join();
+  }
+  if (connect_watchdog.joinable())
+    connect_watchdog.join();
+  if (reactor) {
+    DEBUG_LOG << "Waiting on pipe " << pipepath.filename() << " to close...";
+    while (running) {
+      const uint32_t key(consumer_event.prepare_wait());
+      if (not running) {
+        consumer_event.cancel_wait();
+        break;
+      }
+      consumer_event.commit_wait(key);
+    }
+    // Let the loop finish the iteration that ended the stream, and the tasks
+    // it posted for this receiver, before the receiver can be destroyed.
+    reactor->run_sync(loop, []() {});
   }
-  DLOG(INFO) << "Joining thread for receiver instance " << name << "...";
-  thread.join();
-  DLOG(INFO) << "Joined thread for receiver instance " << name;
+  for (std::thread &worker : workers)
+    worker.join();
+  workers.clear();
+  DEBUG_LOG << "Joined thread for receiver instance " << name;
+  if (pipe_fd == -1)
+    return true;
   if (close(pipe_fd) == -1) {
     LOG(ERROR) << "Failed to close receiver end of pipe " << pipepath.filename() << ", "
                << errno;
     statuscode = errno;
   } else {
-    DLOG(INFO) << "Closed receiver end of pipe " << pipepath.filename();
+    DEBUG_LOG << "Closed receiver end of pipe " << pipepath.filename();
   }
+  pipe_fd = -1;
   LOG(INFO) << "Cleaned up receiver instance " << name;
   return true;
 }
@@ -1,6 +1,10 @@
 #include "../include/sender.hh"
 #include "cppiperconfig.hh"
+#include "logging.hh"
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cerrno>
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
@@ -9,151 +13,1026 @@
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <poll.h>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <thread>
 #include <unistd.h>
 #include <vector>
 
-void cppiper::Sender::run() {
+namespace {
+
+//! First delay between attempts to open a pipe without a reader.
+const std::chrono::milliseconds CONNECT_RETRY_MIN(1);
+//! Longest delay between attempts to open a pipe without a reader.
+const std::chrono::milliseconds CONNECT_RETRY_MAX(50);
+
+//! Open the write end of a pipe without blocking, retrying until a reader
+//! opens the other end.
+/*!
+  \param pipepath path to the pipe.
+  \param deadline time to give up at (time_point::max() for none).
+  \param cancelled flag aborting the attempt when set.
+  \return A non-blocking descriptor, or -1 with errno set (ETIMEDOUT once the
+  deadline passes, ECANCELED once cancelled).
+ */
+int open_writer(const std::filesystem::path &pipepath,
+                std::chrono::steady_clock::time_point deadline,
+                const std::atomic<bool> &cancelled) {
+  std::chrono::milliseconds delay(CONNECT_RETRY_MIN);
   while (true) {
-    std::unique_lock lk(lock);
-    if (not(msg_ready or stop)) {
-      DLOG(INFO) << "Waiting on sender request for pipe " << pipepath.filename()
-                 << "...";
-      msg_conditional.notify_one();
-      msg_conditional.wait(lk, [&]() { return msg_ready or stop; });
-    }
-    statuscode = 0;
-    if (stop) {
-      DLOG(INFO) << "Breaking from sender loop for pipe "
+    // Fails with ENXIO until the receiver has opened the read end.
+    const int fd(open(pipepath.c_str(), O_WRONLY | O_APPEND | O_NONBLOCK));
+    if (fd != -1 or (errno != ENXIO and errno != EINTR))
+      return fd;
+    if (cancelled) {
+      errno = ECANCELED;
+      return -1;
+    }
+    const auto now(std::chrono::steady_clock::now());
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(delay, deadline - now));
+    delay = std::min(delay * 2, CONNECT_RETRY_MAX);
+  }
+}
+
+} // namespace
+
+bool cppiper::Sender::compress_frame(Frame &frame,
+                                     FrameExtensions &extensions) {
+  const size_t raw_size(frame.length());
+  if (raw_size > COMPRESS_MAX_INPUT)
+    return false;
+  const auto start(std::chrono::steady_clock::now());
+  std::string compressed(raw_size, '\0');
+  const size_t compressed_size(compress_block(
+      frame.payload(), raw_size, compressed.data(), raw_size - 1));
+  const auto elapsed(std::chrono::steady_clock::now() - start);
+  {
+    std::lock_guard lk(stats_lock);
+    compression_stats.frames++;
+    compression_stats.raw_bytes += raw_size;
+    compression_stats.compressed_bytes +=
+        compressed_size > 0 ? compressed_size : raw_size;
+    compression_stats.nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  }
+  if (compressed_size == 0) {
+    TRACE_LOG << "Message of " << raw_size << " bytes on pipe "
+              << pipepath.filename() << " is incompressible";
+    return false;
+  }
+  compressed.resize(compressed_size);
+  frame.msg.swap(compressed);
+  frame.borrowed = nullptr;
+  extensions.raw_length = raw_size;
+  return true;
+}
+
+bool cppiper::Sender::encode_frame(Frame &frame) {
+  const uint64_t msg_size(frame.length());
+  if (options.wire_format == WireFormat::HEX) {
+    if (frame.type_tag != 0 or frame.correlation_id != 0) {
+      LOG(ERROR) << "Typed and correlated messages require the binary wire "
+                 << "format on pipe " << pipepath.filename();
+      frame.header_size = 0;
+      return false;
+    }
+    if (msg_size > HEX_MAX_LENGTH) {
+      LOG(ERROR) << "Message of " << msg_size
+                 << " bytes exceeds the hex frame limit on pipe "
                  << pipepath.filename();
+      frame.header_size = 0;
+      return false;
+    }
+    encode_hex_header(msg_size, frame.header);
+    frame.header_size = HEX_HEADER_SIZE;
+    return true;
+  }
+  FrameHeader header{FRAME_MAGIC, FRAME_VERSION, 0, 0, msg_size};
+  FrameExtensions extensions;
+  if (frame.type_tag != 0) {
+    header.flags |= FLAG_TYPED;
+    extensions.type_tag = frame.type_tag;
+  }
+  if (frame.correlation_id != 0) {
+    header.flags |= FLAG_CORRELATED;
+    extensions.correlation_id = frame.correlation_id;
+  }
+  if (options.compression and frame.file_fd == -1 and
+      msg_size >= options.compression_threshold and
+      compress_frame(frame, extensions)) {
+    header.flags |= FLAG_COMPRESSED;
+    header.length = frame.length();
+  }
+  if (options.checksum and frame.file_fd == -1) {
+    header.flags |= FLAG_CHECKSUM;
+    header.checksum = crc32c(frame.payload(), header.length);
+  }
+  encode_header(header, frame.header);
+  frame.header_size =
+      FRAME_HEADER_SIZE + encode_extensions(header.flags, extensions,
+                                            frame.header + FRAME_HEADER_SIZE);
+  return true;
+}
+
+void cppiper::Sender::take_batch(void) {
+  // Shared pipes budget for the largest header, so that a batch never
+  // exceeds PIPE_BUF once encoded and is written atomically.
+  const size_t budget(options.shared_fifo ? PIPE_BUF : chunk_sizer.get());
+  const size_t header_bytes(options.shared_fifo ? FRAME_MAX_HEADER_SIZE
+                                                : FRAME_HEADER_SIZE);
+  size_t batch_bytes(0);
+  size_t taken(0);
+  while (batch.size() < IOV_MAX / 2) {
+    if (carried) {
+      batch.emplace_back(std::move(*carried));
+      carried.reset();
+    } else {
+      batch.emplace_back();
+      if (not queue.try_pop(batch.back())) {
+        batch.pop_back();
+        break;
+      }
+      taken++;
+      if (batch.back().async and batch.back().async->done) {
+        // Its deadline passed while it was queued.
+        batch.pop_back();
+        resolved_count.fetch_add(1);
+        continue;
+      }
+    }
+    const size_t frame_bytes(header_bytes + batch.back().length());
+    if (batch.size() > 1 and batch_bytes + frame_bytes > budget) {
+      carried.emplace(std::move(batch.back()));
+      batch.pop_back();
       break;
     }
-    DLOG(INFO) << "Send request received for pipe " << pipepath.filename();
-    std::stringstream ss;
-    const int msg_size(buffer->size());
-    ss << std::setfill('0') << std::setw(8) << std::hex << msg_size;
-    DLOG(INFO) << "Sending message size bytes over pipe " << pipepath.filename()
-               << "...";
-    if (write(pipe_fd, ss.str().c_str(), 8) < 0) {
-      LOG(ERROR) << "Failed to send message size bytes over pipe "
+    batch_bytes += frame_bytes;
+  }
+  if (taken > 0) {
+    queued.fetch_sub(taken);
+    space_event.notify_all();
+    admit_parked();
+  }
+  counters.observe_depth(queued.load(std::memory_order_relaxed));
+}
+
+void cppiper::Sender::prepare_batch(void) {
+  iov.clear();
+  iov_frames.clear();
+  for (Frame &frame : batch) {
+    if (not encode_frame(frame))
+      continue;
+    iov.push_back({frame.header, frame.header_size});
+    iov_frames.push_back(nullptr);
+    if (frame.file_fd != -1) {
+      iov.push_back({nullptr, frame.file_length});
+      iov_frames.push_back(&frame);
+    } else if (frame.length() > 0) {
+      iov.push_back({const_cast<char *>(frame.payload()), frame.length()});
+      const bool spliced(not frame.borrowed and not options.shared_fifo and
+                         options.splice_threshold > 0 and
+                         frame.msg.size() >= options.splice_threshold);
+      iov_frames.push_back(spliced ? &frame : nullptr);
+    }
+  }
+  iov_index = 0;
+  batch_written = 0;
+  TRACE_EVENT(BATCH_STARTED, counters.get_id(), batch.size());
+  TRACE_LOG << "Sending " << batch.size() << " messages over pipe "
+            << pipepath.filename() << "...";
+}
+
+bool cppiper::Sender::write_batch(void) {
+  if (ring)
+    return write_ring();
+  const unsigned int splice_flags(
+      reactor or options.wait_strategy != WaitStrategy::PARK ? SPLICE_F_NONBLOCK
+                                                             : 0);
+  while (iov_index < iov.size()) {
+    Frame *const source(iov_frames[iov_index]);
+    size_t requested(iov[iov_index].iov_len);
+    ssize_t bytes_written;
+    if (not source) {
+      size_t count(1);
+      while (iov_index + count < iov.size() and
+             count < static_cast<size_t>(IOV_MAX) and
+             not iov_frames[iov_index + count])
+        requested += iov[iov_index + count++].iov_len;
+      bytes_written = writev(pipe_fd, iov.data() + iov_index, count);
+    } else if (source->file_fd == -1) {
+      bytes_written = vmsplice(pipe_fd, iov.data() + iov_index, 1, splice_flags);
+    } else {
+      bytes_written =
+          splice(source->file_fd, &source->file_offset, pipe_fd, nullptr,
+                 iov[iov_index].iov_len, SPLICE_F_MOVE | splice_flags);
+      if (bytes_written == 0) {
+        errno = EIO;
+        bytes_written = -1;
+      }
+    }
+    counters.count_syscall(bytes_written, requested);
+    if (bytes_written < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        return false;
+      LOG(ERROR) << "Failed to send message bytes over pipe "
                  << pipepath.filename() << ", " << errno;
       statuscode = errno;
-      msg_ready = false;
-      lk.unlock();
+      return true;
+    }
+    batch_written += bytes_written;
+    pipe_written += bytes_written;
+    counters.count_bytes(bytes_written);
+    size_t remaining(bytes_written);
+    while (iov_index < iov.size() and remaining >= iov[iov_index].iov_len) {
+      remaining -= iov[iov_index].iov_len;
+      iov_index++;
+    }
+    if (remaining > 0) {
+      if (iov[iov_index].iov_base)
+        iov[iov_index].iov_base =
+            static_cast<char *>(iov[iov_index].iov_base) + remaining;
+      iov[iov_index].iov_len -= remaining;
+    }
+  }
+  statuscode = 0;
+  return true;
+}
+
+void cppiper::Sender::wait_writable(SpinWait &spinner) {
+  if (spinner.spin())
+    return;
+  TRACE_LOG << "Pipe " << pipepath.filename()
+            << " is full, waiting for it to drain...";
+  const auto wait_start(std::chrono::steady_clock::now());
+  // Returns with POLLERR once the receiver is gone, failing the next write.
+  pollfd pfd{pipe_fd, POLLOUT, 0};
+  poll(&pfd, 1, -1);
+  counters.count_blocked(std::chrono::steady_clock::now() - wait_start);
+  spinner.reset();
+}
+
+bool cppiper::Sender::wait_sent(std::future<bool> &sent) {
+  SpinWait spinner(options.wait_strategy, options.spin_budget);
+  while (sent.wait_for(std::chrono::seconds(0)) !=
+             std::future_status::ready and
+         spinner.spin())
+    ;
+  return sent.get();
+}
+
+bool cppiper::Sender::write_ring(void) {
+  SpinWait spinner(options.wait_strategy, options.spin_budget);
+  while (iov_index < iov.size()) {
+    iovec &vec(iov[iov_index]);
+    const size_t bytes_written(ring->write(vec.iov_base, vec.iov_len));
+    if (bytes_written > 0) {
+      batch_written += bytes_written;
+      counters.count_bytes(bytes_written);
+      vec.iov_base = static_cast<char *>(vec.iov_base) + bytes_written;
+      vec.iov_len -= bytes_written;
+      if (vec.iov_len == 0)
+        iov_index++;
       continue;
     }
-    DLOG(INFO) << "Sending message bytes over pipe " << pipepath.filename()
-               << "...";
-    int bytes_written(0);
-    int total_bytes_written(0);
-    while ((bytes_written = write(
-                pipe_fd, &buffer->front() + total_bytes_written,
-                std::min(msg_size - total_bytes_written, buffering_limit))) >
-               0 and
-           (msg_size - (total_bytes_written += bytes_written) > 0)) {
-      if (bytes_written < 0) {
-        LOG(ERROR) << "Failed to send message bytes over pipe "
-                   << pipepath.filename() << ", " << errno;
-        statuscode = errno;
-        msg_ready = false;
-        lk.unlock();
+    if (spinner.spin()) {
+      // The receiver may be parked on the bytes written so far.
+      wake_receiver();
+      continue;
+    }
+    DEBUG_LOG << "Shared memory ring for pipe " << pipepath.filename()
+              << " is full, waiting for it to drain...";
+    wake_receiver();
+    const uint32_t key(ring->prepare_space_wait());
+    if (ring->writable() > 0) {
+      ring->cancel_space_wait();
+      continue;
+    }
+    const auto wait_start(std::chrono::steady_clock::now());
+    const bool woken(
+        ring->commit_space_wait(key, std::chrono::milliseconds(100)));
+    counters.count_blocked(std::chrono::steady_clock::now() - wait_start);
+    spinner.reset();
+    if (woken)
+      continue;
+    pollfd pfd{pipe_fd, 0, 0};
+    if (poll(&pfd, 1, 0) == 1 and (pfd.revents & POLLERR)) {
+      LOG(ERROR) << "Receiver end of pipe " << pipepath.filename()
+                 << " closed with a full shared memory ring";
+      statuscode = EPIPE;
+      return true;
+    }
+  }
+  wake_receiver();
+  statuscode = 0;
+  return true;
+}
+
+void cppiper::Sender::wake_receiver(void) {
+  if (not ring->take_read_wait())
+    return;
+  const char wakeup(0);
+  ssize_t bytes_written;
+  do {
+    bytes_written = write(pipe_fd, &wakeup, 1);
+    counters.count_syscall(bytes_written, 1);
+  } while (bytes_written == -1 and errno == EINTR);
+}
+
+void cppiper::Sender::complete_batch(void) {
+  size_t bytes_written(batch_written);
+  uint64_t frame_end(pipe_written - batch_written);
+  for (Frame &frame : batch) {
+    const size_t frame_bytes(frame.header_size + frame.length());
+    const bool sent(frame.header_size > 0 and bytes_written >= frame_bytes);
+    if (frame.header_size > 0) {
+      frame_end += std::min(bytes_written, frame_bytes);
+      bytes_written = sent ? bytes_written - frame_bytes : 0;
+    }
+    if (sent) {
+      counters.count_messages();
+      TRACE_EVENT(FRAME_SENT, counters.get_id(), frame_bytes);
+      chunk_sizer.observe(frame_bytes);
+    }
+    // Matches the spliced mark of prepare_batch(): only spliced payloads can
+    // still be referenced by the pipe.
+    if (frame.file_fd == -1 and not frame.borrowed and
+        not options.shared_fifo and options.splice_threshold > 0 and
+        frame.msg.size() >= options.splice_threshold and not ring)
+      retired.push_back({std::move(frame.msg), frame_end});
+    if (frame.promise)
+      frame.promise->set_value(sent);
+    else if (frame.async)
+      complete_async(frame.async, sent);
+  }
+  resolved_count.fetch_add(batch.size());
+  batch.clear();
+  iov.clear();
+  iov_frames.clear();
+  iov_index = 0;
+  reclaim_retired();
+  space_event.notify_all();
+}
+
+void cppiper::Sender::reclaim_retired(void) {
+  if (retired.empty())
+    return;
+  int unread(0);
+  if (ioctl(pipe_fd, FIONREAD, &unread) == -1)
+    return;
+  const uint64_t consumed(pipe_written - unread);
+  while (not retired.empty() and retired.front().end <= consumed)
+    retired.pop_front();
+}
+
+void cppiper::Sender::drain_retired(void) {
+  while (true) {
+    reclaim_retired();
+    if (retired.empty())
+      return;
+    pollfd pfd{pipe_fd, 0, 0};
+    if (poll(&pfd, 1, 0) == 1 and (pfd.revents & POLLERR))
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  DEBUG_LOG << "Receiver end of pipe " << pipepath.filename()
+            << " closed before reading every spliced message";
+  retired.clear();
+}
+
+void cppiper::Sender::run() {
+  SpinWait spinner(options.wait_strategy, options.spin_budget);
+  while (true) {
+    take_batch();
+    if (batch.empty()) {
+      // Callers announce themselves before checking stop, so once none is
+      // left every frame they queued is visible.
+      if (stop and producers == 0 and queued == 0) {
+        DEBUG_LOG << "Breaking from sender loop for pipe "
+                  << pipepath.filename();
+        break;
+      }
+      if (spinner.spin())
+        continue;
+      TRACE_LOG << "Waiting on sender request for pipe " << pipepath.filename()
+                << "...";
+      spinner.reset();
+      const uint32_t key(msg_event.prepare_wait());
+      if (queued > 0 or stop) {
+        msg_event.cancel_wait();
+        std::this_thread::yield();
+      } else {
+        msg_event.commit_wait(key);
+      }
+      continue;
+    }
+    TRACE_LOG << "Send request received for pipe " << pipepath.filename();
+    spinner.reset();
+    prepare_batch();
+    while (not write_batch())
+      wait_writable(spinner);
+    spinner.reset();
+    complete_batch();
+  }
+}
+
+void cppiper::Sender::pump(void) {
+  // Frames queued while connecting wait for the first writability event.
+  if (not pipe_open)
+    return;
+  while (true) {
+    if (batch.empty()) {
+      take_batch();
+      if (batch.empty())
+        return;
+      prepare_batch();
+    }
+    if (not write_batch()) {
+      DEBUG_LOG << "Pipe " << pipepath.filename()
+                << " is full, waiting for it to drain...";
+      return;
+    }
+    complete_batch();
+  }
+}
+
+void cppiper::Sender::handle_events(uint32_t) { pump(); }
+
+void cppiper::Sender::drop(Frame &frame) {
+  if (frame.promise)
+    frame.promise->set_value(false);
+  else if (frame.async)
+    complete_async(frame.async, false);
+  queued.fetch_sub(1);
+  resolved_count.fetch_add(1);
+}
+
+void cppiper::Sender::complete_async(const std::shared_ptr<AsyncSend> &async,
+                                     bool sent) {
+  if (async->done.exchange(true))
+    return;
+  if (not reactor) {
+    async->callback(sent);
+    return;
+  }
+  reactor->cancel_timer(async->timer);
+  reactor->post(loop, [async, sent]() { async->callback(sent); });
+}
+
+bool cppiper::Sender::try_reserve(void) {
+  if (queued.fetch_add(1) < options.queue_capacity)
+    return true;
+  queued.fetch_sub(1);
+  return false;
+}
+
+void cppiper::Sender::admit_parked(void) {
+  if (parked_count == 0)
+    return;
+  // Announced like any caller, so terminate() waits for the frames admitted
+  // here to be queued.
+  producers.fetch_add(1);
+  {
+    std::lock_guard lk(parked_lock);
+    while (not parked.empty() and not stop) {
+      if (not parked.front().async->done) {
+        if (not try_reserve())
+          break;
+        push(parked.front());
+      }
+      parked.pop_front();
+      parked_count--;
+    }
+  }
+  producers.fetch_sub(1);
+}
+
+void cppiper::Sender::fail_parked(void) {
+  std::lock_guard lk(parked_lock);
+  if (not parked.empty())
+    DEBUG_LOG << "Failing " << parked.size()
+              << " parked messages on sender instance " << name;
+  for (Frame &frame : parked)
+    complete_async(frame.async, false);
+  parked.clear();
+  parked_count = 0;
+}
+
+void cppiper::Sender::push(Frame &frame) {
+  TRACE_EVENT(SEND_QUEUED, counters.get_id(), frame.length());
+  // The queue only overflows its capacity when dropping callers race.
+  while (not queue.try_push(frame)) {
+    Frame oldest;
+    if (queue.try_pop(oldest))
+      drop(oldest);
+  }
+  enqueued_count.fetch_add(1);
+  counters.observe_depth(queued.load(std::memory_order_relaxed));
+  if (not reactor)
+    msg_event.notify_one();
+  else if (not wake_pending.exchange(true))
+    reactor->post(loop, [this]() {
+      wake_pending = false;
+      pump();
+    });
+}
+
+bool cppiper::Sender::reserve(bool may_block) {
+  while (queued.fetch_add(1) >= options.queue_capacity) {
+    switch (options.overflow_policy) {
+    case OverflowPolicy::BLOCK:
+      if (may_block) {
+        queued.fetch_sub(1);
+        DEBUG_LOG << "Outbound queue full on sender instance " << name
+                  << ", waiting...";
+        TRACE_EVENT(SEND_BLOCKED, counters.get_id(), queued.load());
+        const auto wait_start(std::chrono::steady_clock::now());
+        SpinWait spinner(options.wait_strategy, options.spin_budget);
+        while (queued >= options.queue_capacity and not stop and
+               spinner.spin())
+          ;
+        while (queued >= options.queue_capacity and not stop) {
+          const uint32_t key(space_event.prepare_wait());
+          if (queued < options.queue_capacity or stop) {
+            space_event.cancel_wait();
+            break;
+          }
+          space_event.commit_wait(key);
+        }
+        counters.count_blocked(std::chrono::steady_clock::now() - wait_start);
+        if (stop)
+          return false;
         continue;
       }
-    };
-    msg_ready = false;
-    lk.unlock();
+      [[fallthrough]];
+    case OverflowPolicy::FAIL:
+      queued.fetch_sub(1);
+      DEBUG_LOG << "Outbound queue full on sender instance " << name
+                << ", rejecting message";
+      return false;
+    case OverflowPolicy::DROP_OLDEST: {
+      DEBUG_LOG << "Outbound queue full on sender instance " << name
+                << ", dropping oldest message";
+      Frame oldest;
+      if (queue.try_pop(oldest))
+        drop(oldest);
+      return true;
+    }
+    }
   }
+  return true;
+}
+
+bool cppiper::Sender::enqueue(Frame &&frame, bool may_block) {
+  if (options.shared_fifo and frame.length() > SHARED_FIFO_MAX_PAYLOAD) {
+    LOG(ERROR) << "Message of " << frame.length()
+               << " bytes exceeds the shared pipe limit on sender instance "
+               << name;
+    return false;
+  }
+  // Announced before checking stop, so terminate() either waits for this
+  // caller or this caller sees the stop.
+  producers.fetch_add(1);
+  // Sends with a callback park their frame rather than block on a full queue.
+  const bool park(frame.async and
+                  options.overflow_policy == OverflowPolicy::BLOCK);
+  if (stop or not(park ? try_reserve() : reserve(may_block))) {
+    if (park and not stop) {
+      DEBUG_LOG << "Outbound queue full on sender instance " << name
+                << ", parking message";
+      {
+        std::lock_guard lk(parked_lock);
+        parked.push_back(std::move(frame));
+        parked_count++;
+      }
+      producers.fetch_sub(1);
+      // The queue may have drained before the frame was parked.
+      if (queued < options.queue_capacity)
+        admit_parked();
+      return true;
+    }
+    producers.fetch_sub(1);
+    if (stop)
+      LOG(WARNING)
+          << "Attempt to send message on non-running sender instance for "
+          << name << ", " << errno;
+    return false;
+  }
+  push(frame);
+  producers.fetch_sub(1);
+  return true;
 }
 
 cppiper::Sender::Sender(const std::string name,
-                        const std::filesystem::path pipepath)
+                        const std::filesystem::path pipepath,
+                        const SenderOptions &options)
     : name(name), pipepath(std::filesystem::absolute(pipepath)),
-      buffer(nullptr), buffering_limit(65536), statuscode(0), pipe_fd(-1),
-      msg_ready(false), stop(false), lock{}, msg_conditional{} {
-  DLOG(INFO) << "Initialising sender thread for pipe " << pipepath.filename();
+      options(options), chunk_sizer(options.chunk_size),
+      reactor(options.transport == Transport::FIFO ? options.reactor
+                                                   : nullptr),
+      loop(reactor ? reactor->choose_loop() : -1), statuscode(0), pipe_fd(-1),
+      pipe_open(false), connect_promise(),
+      connect_future(connect_promise.get_future().share()), ring(), stop(true),
+      producers(0), queue(std::max<size_t>(options.queue_capacity, 1)),
+      queued(0), enqueued_count(0), resolved_count(0), msg_event(),
+      space_event(), carried(), batch{}, iov{}, iov_frames{}, iov_index(0),
+      batch_written(0), pipe_written(0), retired{}, wake_pending(false),
+      parked_lock(), parked(), parked_count(0), counters(),
+      compression_stats{}, stats_lock{} {
+  batch.reserve(IOV_MAX / 2);
+  iov.reserve(IOV_MAX);
+  iov_frames.reserve(IOV_MAX);
+  MetricsRegistry::instance().add(this);
+  DEBUG_LOG << "Initialising sender thread for pipe " << pipepath.filename();
   int retcode;
   if (not std::filesystem::exists(pipepath)) {
-    DLOG(INFO) << "Pipe " << pipepath << " does not exist, creating...";
+    DEBUG_LOG << "Pipe " << pipepath << " does not exist, creating...";
     retcode = mkfifo(pipepath.c_str(), 00666);
     if (retcode == -1) {
       LOG(ERROR) << "Failed to open sender pipe " << pipepath << ", " << errno;
-      statuscode = errno;
+      abandon(errno);
       return;
     }
   } else if (not std::filesystem::is_fifo(pipepath)) {
     LOG(ERROR) << "File at provided sender path " << pipepath
                << " is not a fifo pipe"
                << ", " << errno;
-    statuscode = 95;
+    abandon(95);
     return;
   }
-  DLOG(INFO) << "Opening sender end of pipe " << pipepath << "...";
-  pipe_fd = open(pipepath.c_str(), O_WRONLY | O_APPEND);
-  if (pipe_fd == -1) {
-    LOG(ERROR) << "Failed to open sender pipe " << pipepath << ", " << errno;
-    statuscode = errno;
+  if (options.shared_fifo and options.transport != Transport::FIFO) {
+    LOG(ERROR) << "Sender instance " << name
+               << " can only share a pipe with the FIFO transport";
+    abandon(EINVAL);
     return;
   }
-  DLOG(INFO) << "Entering sender loop for pipe " << pipepath.filename()
-             << "...";
-  thread = std::thread(&Sender::run, this);
+  if (options.transport == Transport::SHARED_MEMORY) {
+    if (options.reactor)
+      LOG(WARNING) << "Shared memory sender " << name
+                   << " ignores its reactor and runs its own thread";
+    DEBUG_LOG << "Creating shared memory ring for pipe "
+              << pipepath.filename() << "...";
+    ring = std::make_unique<ShmRing>();
+    if (not ring->create(this->pipepath, options.ring_capacity)) {
+      abandon(errno);
+      ring.reset();
+      return;
+    }
+  }
+  // Stopping from here on cancels connecting.
+  stop = false;
+  if (options.async_connect) {
+    DEBUG_LOG << "Connecting sender end of pipe " << pipepath.filename()
+              << " in the background...";
+    thread = std::thread(&Sender::run_connect, this);
+  } else {
+    if (not connect())
+      return;
+    if (not reactor) {
+      DEBUG_LOG << "Entering sender loop for pipe " << pipepath.filename()
+                << "...";
+      thread = std::thread(&Sender::run, this);
+    }
+  }
+  // A sender connecting in the background runs its loop on the connecting
+  // thread.
+  if (thread.joinable() and not reactor)
+    apply_thread_options(thread.native_handle(), options.thread_options,
+                         name);
   LOG(INFO) << "Constructed sender instance " << name << " with pipe "
             << this->pipepath.filename();
 }
 
+bool cppiper::Sender::connect(void) {
+  DEBUG_LOG << "Opening sender end of pipe " << pipepath << "...";
+  const bool bounded(options.async_connect or
+                     options.connect_timeout.count() > 0);
+  const int fd(
+      bounded ? open_writer(pipepath,
+                            options.connect_timeout.count() > 0
+                                ? deadline_after(options.connect_timeout)
+                                : std::chrono::steady_clock::time_point::max(),
+                            stop)
+              : open(pipepath.c_str(), O_WRONLY | O_APPEND));
+  if (fd == -1) {
+    if (errno == ECANCELED)
+      DEBUG_LOG << "Stopped connecting sender pipe " << pipepath;
+    else
+      LOG(ERROR) << "Failed to open sender pipe " << pipepath << ", " << errno;
+    abandon(errno);
+    return false;
+  }
+  pipe_fd = fd;
+  const size_t capacity(
+      tune_pipe_capacity(pipe_fd, options.pipe_capacity, pipepath));
+  chunk_sizer.set_limit(ring ? ring->get_capacity() / 2
+                             : capacity > 0 ? capacity : CHUNK_SIZE_DEFAULT);
+  // The sender thread writes with blocking calls unless it spins, the
+  // reactor with non-blocking ones.
+  const bool nonblocking(reactor or
+                         options.wait_strategy != WaitStrategy::PARK);
+  const int flags(fcntl(pipe_fd, F_GETFL));
+  if (flags == -1 or
+      fcntl(pipe_fd, F_SETFL,
+            nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == -1) {
+    LOG(ERROR) << "Failed to set the blocking mode of sender pipe "
+               << pipepath << ", " << errno;
+    abandon(errno);
+    close(pipe_fd);
+    pipe_fd = -1;
+    return false;
+  }
+  // Set before attaching, so the first writability event pumps the
+  // messages queued while connecting.
+  pipe_open = true;
+  if (reactor) {
+    DEBUG_LOG << "Attaching sender end of pipe " << pipepath.filename()
+              << " to reactor...";
+    if (not reactor->attach(loop, pipe_fd, EPOLLOUT | EPOLLET, this)) {
+      LOG(ERROR) << "Failed to attach sender pipe " << pipepath
+                 << " to reactor, " << errno;
+      pipe_open = false;
+      abandon(errno);
+      close(pipe_fd);
+      pipe_fd = -1;
+      return false;
+    }
+  }
+  connect_promise.set_value(true);
+  return true;
+}
+
+void cppiper::Sender::run_connect(void) {
+  if (connect()) {
+    if (not reactor) {
+      DEBUG_LOG << "Entering sender loop for pipe " << pipepath.filename()
+                << "...";
+      run();
+    }
+    return;
+  }
+  // Fail the messages sent while connecting.
+  while (producers > 0)
+    std::this_thread::yield();
+  Frame frame;
+  while (queue.try_pop(frame))
+    drop(frame);
+  fail_parked();
+  space_event.notify_all();
+}
+
+void cppiper::Sender::abandon(int code) {
+  statuscode = code;
+  stop = true;
+  connect_promise.set_value(false);
+}
+
+void cppiper::Sender::abandon_loop(void) {
+  // Pumps posted while connecting may still be pending on the loop.
+  if (reactor and not pipe_open)
+    reactor->run_sync(loop, []() {});
+}
+
+cppiper::Sender::~Sender(void) { MetricsRegistry::instance().remove(this); }
+
 int cppiper::Sender::get_status_code(void) const { return statuscode; };
 
+std::shared_future<bool> cppiper::Sender::connected(void) const {
+  return connect_future;
+}
+
 bool cppiper::Sender::send(const std::string &msg) {
-  LOG(INFO) << "Sending message on sender instance " << name;
-  if (not thread.joinable() or stop) {
-    LOG(WARNING)
-        << "Attempt to send message on non-running sender instance for " << name
-        << ", " << errno;
+  return send_view(msg.data(), msg.size(), 0);
+}
+
+bool cppiper::Sender::send(std::string_view msg) {
+  return send_view(msg.data(), msg.size(), 0);
+}
+
+bool cppiper::Sender::send(const char *msg) {
+  return send(std::string_view(msg));
+}
+
+bool cppiper::Sender::send(const void *data, size_t size) {
+  return send_view(static_cast<const char *>(data), size, 0);
+}
+
+bool cppiper::Sender::send_view(const char *data, size_t size,
+                                uint64_t type_tag) {
+  TRACE_LOG << "Sending message on sender instance " << name;
+  std::promise<bool> promise;
+  std::future<bool> sent(promise.get_future());
+  if (not enqueue(Frame(data ? data : "", size, type_tag, std::move(promise)),
+                  true) or
+      not wait_sent(sent)) {
+    LOG(ERROR) << "Message failed to send on sender instance " << name << ", "
+               << statuscode;
     return false;
   }
-  {
-    std::lock_guard lk(lock);
-    buffer = &msg;
-    msg_ready = true;
-  }
-  std::unique_lock lk(lock);
-  msg_conditional.notify_one();
-  if (msg_ready)
-    msg_conditional.wait(lk, [&]() { return not msg_ready; });
-  if (statuscode == 0)
-    LOG(INFO) << "Message sent on sender instance " << name;
-  else
-    LOG(ERROR) << "Message failed to send on sender instance " << name << ", "
-               << errno;
-  return statuscode == 0;
+  TRACE_LOG << "Message sent on sender instance " << name;
+  return true;
+}
+
+bool cppiper::Sender::send(std::string msg, std::chrono::nanoseconds timeout) {
+  return send(std::move(msg), deadline_after(timeout));
+}
+
+bool cppiper::Sender::send(std::string msg,
+                           std::chrono::steady_clock::time_point deadline) {
+  TRACE_LOG << "Sending message with a deadline on sender instance " << name;
+  // Completed like a send with a callback, so the frame parks rather than
+  // blocks on a full queue and is discarded once the deadline passes.
+  auto written(std::make_shared<std::promise<bool>>());
+  std::future<bool> sent(written->get_future());
+  auto async(std::make_shared<AsyncSend>());
+  async->callback = [written](bool ok) { written->set_value(ok); };
+  Frame frame(std::move(msg), std::nullopt);
+  frame.async = async;
+  if (not enqueue(std::move(frame), false))
+    return false;
+  if (sent.wait_until(deadline) == std::future_status::timeout and
+      not async->done.exchange(true)) {
+    DEBUG_LOG << "Message timed out on sender instance " << name;
+    return false;
+  }
+  return sent.get();
+}
+
+std::future<bool> cppiper::Sender::send_async(std::string msg,
+                                              uint64_t correlation_id) {
+  std::promise<bool> promise;
+  std::future<bool> future(promise.get_future());
+  Frame frame(std::move(msg), std::move(promise), correlation_id);
+  if (not enqueue(std::move(frame), true)) {
+    std::promise<bool> rejected;
+    rejected.set_value(false);
+    return rejected.get_future();
+  }
+  return future;
+}
+
+void cppiper::Sender::send_async(std::string msg, SendCallback callback,
+                                 std::chrono::steady_clock::time_point deadline,
+                                 uint64_t correlation_id) {
+  if (not reactor and
+      deadline != std::chrono::steady_clock::time_point::max()) {
+    LOG(ERROR) << "Sender instance " << name
+               << " needs a reactor to send with a deadline";
+    callback(false);
+    return;
+  }
+  auto async(std::make_shared<AsyncSend>());
+  async->callback = std::move(callback);
+  // Scheduled first, so the send cannot complete before its timer exists.
+  if (deadline != std::chrono::steady_clock::time_point::max())
+    async->timer = reactor->add_timer(loop, deadline, [async]() {
+      if (not async->done.exchange(true))
+        async->callback(false);
+    });
+  Frame frame(std::move(msg), std::nullopt, correlation_id);
+  frame.async = async;
+  if (not enqueue(std::move(frame), false))
+    complete_async(async, false);
+}
+
+bool cppiper::Sender::send_file(int fd, off_t offset, size_t length) {
+  TRACE_LOG << "Sending " << length << " bytes of file descriptor " << fd
+            << " on sender instance " << name;
+  if (ring or options.shared_fifo) {
+    LOG(ERROR) << (ring ? "Shared memory" : "Shared pipe") << " sender instance "
+               << name << " cannot send files";
+    return false;
+  }
+  const int file_fd(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+  if (file_fd == -1) {
+    LOG(ERROR) << "Failed to duplicate file descriptor " << fd
+               << " on sender instance " << name << ", " << errno;
+    return false;
+  }
+  std::promise<bool> promise;
+  std::future<bool> sent(promise.get_future());
+  if (not enqueue(Frame(file_fd, offset, length, std::move(promise)), true) or
+      not wait_sent(sent)) {
+    LOG(ERROR) << "File failed to send on sender instance " << name << ", "
+               << statuscode;
+    return false;
+  }
+  return true;
+}
+
+bool cppiper::Sender::try_send(std::string msg) {
+  return enqueue(Frame(std::move(msg), std::nullopt), false);
+}
+
+bool cppiper::Sender::flush(void) {
+  const uint64_t target(enqueued_count.load());
+  while (resolved_count < target and not stop) {
+    const uint32_t key(space_event.prepare_wait());
+    if (resolved_count >= target or stop) {
+      space_event.cancel_wait();
+      break;
+    }
+    space_event.commit_wait(key);
+  }
+  return not stop;
+}
+
+size_t cppiper::Sender::queue_size(void) {
+  return queued.load(std::memory_order_relaxed);
+}
+
+uint64_t cppiper::Sender::get_msg_count(void) const {
+  return counters.get_messages();
+}
+
+size_t cppiper::Sender::get_pipe_capacity(void) const {
+  const int capacity(not pipe_open ? -1 : fcntl(pipe_fd, F_GETPIPE_SZ));
+  return capacity == -1 ? 0 : capacity;
+}
+
+size_t cppiper::Sender::get_chunk_size(void) const { return chunk_sizer.get(); }
+
+cppiper::CompressionStats
+cppiper::Sender::get_compression_stats(void) const {
+  std::lock_guard lk(stats_lock);
+  return compression_stats;
+}
+
+uint64_t cppiper::Sender::get_write_count(void) const {
+  return counters.get_syscalls();
+}
+
+cppiper::EndpointStats cppiper::Sender::stats(void) const {
+  EndpointStats stats;
+  stats.name = name;
+  stats.pipe = pipepath;
+  stats.role = EndpointRole::SENDER;
+  stats.status_code = statuscode;
+  counters.snapshot(stats);
+  return stats;
 }
 
 bool cppiper::Sender::terminate(void) {
-  DLOG(INFO) << "Terminating sender instance " << name << "...";
-  if (not thread.joinable() or stop) {
+  DEBUG_LOG << "Terminating sender instance " << name << "...";
+  if (stop.exchange(true)) {
+    // Never connected, already terminated, or failed to connect in the
+    // background.
+    if (thread.joinable())
+      thread.join();
+    abandon_loop();
     return true;
   }
-  {
-    std::lock_guard lk(lock);
-    stop = true;
+  space_event.notify_all();
+  while (producers > 0)
+    std::this_thread::yield();
+  fail_parked();
+  // Waits for a background connect, which gives up once stopped.
+  if (not connect_future.get()) {
+    thread.join();
+    abandon_loop();
+    return true;
+  }
+  if (reactor) {
+    DEBUG_LOG << "Draining sender instance " << name << "...";
+    while (resolved_count < enqueued_count) {
+      const uint32_t key(space_event.prepare_wait());
+      if (resolved_count >= enqueued_count) {
+        space_event.cancel_wait();
+        break;
+      }
+      space_event.commit_wait(key);
+    }
+    reactor->detach(loop, pipe_fd);
+    if (thread.joinable())
+      thread.join();
+  } else {
+    msg_event.notify_all();
+    DEBUG_LOG << "Joining thread for sender instance " << name << "...";
+    thread.join();
   }
-  msg_conditional.notify_one();
-  DLOG(INFO) << "Joining thread for sender instance " << name << "...";
-  thread.join();
+  drain_retired();
   if (close(pipe_fd) < 0) {
     LOG(ERROR) << "Failed to close sender end for pipe " << pipepath.filename()
                << ", " << errno;
     statuscode = 6;
   } else
-    DLOG(INFO) << "Closed sender end for pipe " << pipepath.filename();
-  DLOG(INFO) << "Joined thread for sender instance " << name;
+    DEBUG_LOG << "Closed sender end for pipe " << pipepath.filename();
+  DEBUG_LOG << "Joined thread for sender instance " << name;
   LOG(INFO) << "Terminated sender instance " << name;
   return true;
 }
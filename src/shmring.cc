@@ -0,0 +1,269 @@
+#include "../include/shmring.hh"
+#include "../include/eventcount.hh"
+#include "../include/spscqueue.hh"
+#include "cppiperconfig.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+//! Identifies an initialised ring control block.
+const uint32_t SHM_RING_MAGIC = 0x43505252;
+
+//! Ring control block layout version.
+const uint32_t SHM_RING_VERSION = 1;
+
+//! Offset of the ring storage in the segment (keeps it page aligned).
+const size_t SHM_RING_DATA_OFFSET = 4096;
+
+} // namespace
+
+//! Ring control block shared by both peers.
+struct cppiper::ShmRing::Header {
+  //! Construct a reset control block (the consumer starts out waiting, so
+  //! the first write always wakes it).
+  explicit Header(uint64_t capacity)
+      : magic(SHM_RING_MAGIC), version(SHM_RING_VERSION), capacity(capacity),
+        head(0), tail(0), read_waiting(1), space_event(true) {}
+  //! Always SHM_RING_MAGIC.
+  uint32_t magic;
+  //! Control block layout version.
+  uint32_t version;
+  //! Ring storage capacity.
+  uint64_t capacity;
+  //! Total number of bytes consumed.
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+  //! Total number of bytes produced.
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+  //! Set by a consumer about to wait on the pipe for data.
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> read_waiting;
+  //! Event the producer parks on while the ring is full.
+  EventCount space_event;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory rings require lock-free 64-bit atomics");
+
+cppiper::ShmRing::ShmRing(void)
+    : fd(-1), map_size(0), map(nullptr), header(nullptr), data(nullptr),
+      capacity(0), cached_head(0), cached_tail(0) {}
+
+cppiper::ShmRing::~ShmRing(void) { unmap(); }
+
+std::string
+cppiper::ShmRing::segment_name(const std::filesystem::path &pipepath) {
+  const std::string path(
+      std::filesystem::absolute(pipepath).lexically_normal().string());
+  uint64_t hash(14695981039346656037ULL);
+  for (const char c : path) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  std::stringstream ss;
+  ss << "/cppiper-" << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+bool cppiper::ShmRing::create_segment(const std::filesystem::path &pipepath,
+                                      size_t capacity) {
+  const std::string segment(segment_name(pipepath));
+  const int segment_fd(shm_open(segment.c_str(), O_RDWR | O_CREAT, 00666));
+  if (segment_fd == -1) {
+    LOG(ERROR) << "Failed to create shared memory segment " << segment
+               << " for pipe " << pipepath.filename() << ", " << errno;
+    return false;
+  }
+  struct stat st;
+  bool created(fstat(segment_fd, &st) == 0);
+  if (created and st.st_size == 0)
+    created = ftruncate(segment_fd,
+                        SHM_RING_DATA_OFFSET + ring_capacity(capacity)) == 0;
+  if (not created)
+    LOG(ERROR) << "Failed to size shared memory segment " << segment << ", "
+               << errno;
+  else
+    DEBUG_LOG << "Shared memory segment " << segment << " ready for pipe "
+              << pipepath.filename();
+  close(segment_fd);
+  return created;
+}
+
+bool cppiper::ShmRing::remove_segment(const std::filesystem::path &pipepath) {
+  const std::string segment(segment_name(pipepath));
+  if (shm_unlink(segment.c_str()) == -1) {
+    if (errno != ENOENT)
+      LOG(ERROR) << "Failed to remove shared memory segment " << segment
+                 << ", " << errno;
+    return false;
+  }
+  DEBUG_LOG << "Removed shared memory segment " << segment;
+  return true;
+}
+
+bool cppiper::ShmRing::map_segment(const std::filesystem::path &pipepath,
+                                   size_t capacity) {
+  unmap();
+  const std::string segment(segment_name(pipepath));
+  fd = shm_open(segment.c_str(), O_RDWR | (capacity > 0 ? O_CREAT : 0), 00666);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to open shared memory segment " << segment
+               << " for pipe " << pipepath.filename() << ", " << errno;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    LOG(ERROR) << "Failed to stat shared memory segment " << segment << ", "
+               << errno;
+    unmap();
+    return false;
+  }
+  map_size = st.st_size;
+  if (map_size == 0 and capacity > 0) {
+    map_size = SHM_RING_DATA_OFFSET + ring_capacity(capacity);
+    if (ftruncate(fd, map_size) == -1) {
+      LOG(ERROR) << "Failed to size shared memory segment " << segment << ", "
+                 << errno;
+      unmap();
+      return false;
+    }
+  }
+  if (map_size <= SHM_RING_DATA_OFFSET) {
+    LOG(ERROR) << "Shared memory segment " << segment << " is too small";
+    errno = EINVAL;
+    unmap();
+    return false;
+  }
+  map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map shared memory segment " << segment << ", "
+               << errno;
+    map = nullptr;
+    unmap();
+    return false;
+  }
+  data = static_cast<char *>(map) + SHM_RING_DATA_OFFSET;
+  return true;
+}
+
+void cppiper::ShmRing::unmap(void) {
+  if (map)
+    munmap(map, map_size);
+  if (fd != -1)
+    close(fd);
+  fd = -1;
+  map_size = 0;
+  map = nullptr;
+  header = nullptr;
+  data = nullptr;
+  capacity = 0;
+}
+
+bool cppiper::ShmRing::create(const std::filesystem::path &pipepath,
+                              size_t capacity) {
+  static_assert(sizeof(Header) <= SHM_RING_DATA_OFFSET,
+                "Ring control block must fit before the ring storage");
+  if (not map_segment(pipepath, std::max<size_t>(capacity, 1)))
+    return false;
+  uint64_t usable(2);
+  while (usable * 2 <= map_size - SHM_RING_DATA_OFFSET)
+    usable *= 2;
+  header = new (map) Header(usable);
+  this->capacity = usable;
+  cached_head = cached_tail = 0;
+  DEBUG_LOG << "Reset " << usable << " byte shared memory ring for pipe "
+            << pipepath.filename();
+  return true;
+}
+
+bool cppiper::ShmRing::open(const std::filesystem::path &pipepath) {
+  if (not map_segment(pipepath, 0))
+    return false;
+  header = static_cast<Header *>(map);
+  if (header->magic != SHM_RING_MAGIC or
+      header->version != SHM_RING_VERSION or header->capacity < 2 or
+      (header->capacity & (header->capacity - 1)) != 0 or
+      header->capacity > map_size - SHM_RING_DATA_OFFSET) {
+    LOG(ERROR) << "Shared memory segment for pipe " << pipepath.filename()
+               << " does not hold a valid ring";
+    errno = EPROTO;
+    unmap();
+    return false;
+  }
+  capacity = header->capacity;
+  cached_head = header->head.load(std::memory_order_acquire);
+  cached_tail = header->tail.load(std::memory_order_acquire);
+  return true;
+}
+
+size_t cppiper::ShmRing::get_capacity(void) const { return capacity; }
+
+size_t cppiper::ShmRing::write(const void *src, size_t len) {
+  const uint64_t tail(header->tail.load(std::memory_order_relaxed));
+  if (capacity - (tail - cached_head) < len)
+    cached_head = header->head.load(std::memory_order_acquire);
+  const size_t count(std::min<uint64_t>(len, capacity - (tail - cached_head)));
+  if (count == 0)
+    return 0;
+  const size_t offset(tail & (capacity - 1));
+  const size_t first(std::min<size_t>(count, capacity - offset));
+  std::memcpy(data + offset, src, first);
+  std::memcpy(data, static_cast<const char *>(src) + first, count - first);
+  header->tail.store(tail + count, std::memory_order_release);
+  return count;
+}
+
+size_t cppiper::ShmRing::read(void *dst, size_t len) {
+  const uint64_t head(header->head.load(std::memory_order_relaxed));
+  if (cached_tail - head < len)
+    cached_tail = header->tail.load(std::memory_order_acquire);
+  const size_t count(std::min<uint64_t>(len, cached_tail - head));
+  if (count == 0)
+    return 0;
+  const size_t offset(head & (capacity - 1));
+  const size_t first(std::min<size_t>(count, capacity - offset));
+  std::memcpy(dst, data + offset, first);
+  std::memcpy(static_cast<char *>(dst) + first, data, count - first);
+  header->head.store(head + count, std::memory_order_release);
+  return count;
+}
+
+size_t cppiper::ShmRing::writable(void) {
+  cached_head = header->head.load(std::memory_order_acquire);
+  return capacity - (header->tail.load(std::memory_order_relaxed) - cached_head);
+}
+
+void cppiper::ShmRing::prepare_read_wait(void) {
+  header->read_waiting.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool cppiper::ShmRing::take_read_wait(void) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return header->read_waiting.load(std::memory_order_relaxed) != 0 and
+         header->read_waiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+uint32_t cppiper::ShmRing::prepare_space_wait(void) {
+  return header->space_event.prepare_wait();
+}
+
+void cppiper::ShmRing::cancel_space_wait(void) {
+  header->space_event.cancel_wait();
+}
+
+bool cppiper::ShmRing::commit_space_wait(uint32_t key,
+                                         std::chrono::nanoseconds timeout) {
+  return header->space_event.commit_wait(key, timeout);
+}
+
+void cppiper::ShmRing::notify_space(void) { header->space_event.notify_one(); }
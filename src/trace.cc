@@ -0,0 +1,133 @@
+#include "../include/trace.hh"
+#include "../include/spscqueue.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+//! A trace ring slot, guarded by a sequence number so dumps can skip slots
+//! being overwritten.
+struct alignas(32) Slot {
+  //! 2 * (record index + 1) once written, odd while being written.
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> timestamp;
+  std::atomic<uint64_t> value;
+  //! Endpoint identifier in the high bits, event in the low 16 bits.
+  std::atomic<uint64_t> tag;
+};
+
+//! Lock serialising enable().
+std::mutex ring_lock;
+//! Ring storage (allocated once and never freed).
+std::atomic<Slot *> ring_slots(nullptr);
+//! Ring capacity, set before the storage is published.
+size_t ring_capacity_mask(0);
+//! Index of the next record.
+std::atomic<uint64_t> ring_position(0);
+//! Whether or not events are recorded.
+std::atomic<bool> ring_active(false);
+
+} // namespace
+
+const char *cppiper::trace_event_name(TraceEvent event) {
+  switch (event) {
+  case TraceEvent::SEND_QUEUED:
+    return "send_queued";
+  case TraceEvent::BATCH_STARTED:
+    return "batch_started";
+  case TraceEvent::FRAME_SENT:
+    return "frame_sent";
+  case TraceEvent::SEND_BLOCKED:
+    return "send_blocked";
+  case TraceEvent::READ:
+    return "read";
+  case TraceEvent::FRAME_RECEIVED:
+    return "frame_received";
+  case TraceEvent::MESSAGE_TAKEN:
+    return "message_taken";
+  case TraceEvent::RECEIVE_PAUSED:
+    return "receive_paused";
+  case TraceEvent::RECEIVE_RESUMED:
+    return "receive_resumed";
+  }
+  return "unknown";
+}
+
+bool cppiper::TraceRing::enable(size_t capacity) {
+#if CPPIPER_TRACE == ON
+  std::lock_guard lk(ring_lock);
+  if (not ring_slots.load(std::memory_order_relaxed)) {
+    capacity = ring_capacity(std::max<size_t>(capacity, 2));
+    ring_capacity_mask = capacity - 1;
+    ring_slots.store(new Slot[capacity](), std::memory_order_release);
+    DEBUG_LOG << "Allocated trace ring of " << capacity << " records";
+  }
+  ring_active.store(true, std::memory_order_release);
+  return true;
+#else
+  (void)capacity;
+  LOG(WARNING) << "Tracing was not compiled in, rebuild with -DTRACE=ON";
+  return false;
+#endif
+}
+
+void cppiper::TraceRing::disable(void) {
+  ring_active.store(false, std::memory_order_relaxed);
+}
+
+void cppiper::TraceRing::record(TraceEvent event, uint32_t endpoint,
+                                uint64_t value) {
+  if (not ring_active.load(std::memory_order_acquire))
+    return;
+  Slot *const slots(ring_slots.load(std::memory_order_acquire));
+  const uint64_t index(ring_position.fetch_add(1, std::memory_order_relaxed));
+  Slot &slot(slots[index & ring_capacity_mask]);
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count(),
+                       std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  slot.tag.store(static_cast<uint64_t>(endpoint) << 16 |
+                     static_cast<uint16_t>(event),
+                 std::memory_order_relaxed);
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+std::vector<cppiper::TraceRecord> cppiper::TraceRing::dump(void) {
+  std::vector<TraceRecord> records;
+  Slot *const slots(ring_slots.load(std::memory_order_acquire));
+  if (not slots)
+    return records;
+  const uint64_t end(ring_position.load(std::memory_order_acquire));
+  const uint64_t capacity(ring_capacity_mask + 1);
+  const uint64_t begin(end > capacity ? end - capacity : 0);
+  records.reserve(end - begin);
+  for (uint64_t index = begin; index < end; index++) {
+    Slot &slot(slots[index & ring_capacity_mask]);
+    const uint64_t sequence(slot.sequence.load(std::memory_order_acquire));
+    if (sequence != 2 * index + 2)
+      continue;
+    TraceRecord record;
+    record.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    record.value = slot.value.load(std::memory_order_relaxed);
+    const uint64_t tag(slot.tag.load(std::memory_order_relaxed));
+    record.endpoint = static_cast<uint32_t>(tag >> 16);
+    record.event = static_cast<TraceEvent>(tag & 0xFFFF);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+      records.push_back(record);
+  }
+  return records;
+}
+
+void cppiper::TraceRing::write(std::ostream &out) {
+  for (const TraceRecord &record : dump())
+    out << record.timestamp << ' ' << record.endpoint << ' '
+        << trace_event_name(record.event) << ' ' << record.value << '\n';
+  out.flush();
+}
@@ -0,0 +1,136 @@
+#include "../include/tuning.hh"
+#include "../include/spscqueue.hh"
+#include "cppiperconfig.hh"
+#include "logging.hh"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <glog/logging.h>
+#include <sched.h>
+
+cppiper::ChunkSizer::ChunkSizer(size_t fixed)
+    : fixed(fixed), limit(CHUNK_SIZE_MAX), average(0), observed(0),
+      chunk(fixed > 0 ? fixed : CHUNK_SIZE_DEFAULT) {}
+
+void cppiper::ChunkSizer::set_limit(size_t limit) {
+  if (fixed > 0)
+    return;
+  this->limit = std::clamp(limit, CHUNK_SIZE_MIN, CHUNK_SIZE_MAX);
+  chunk = std::min(chunk.load(std::memory_order_relaxed), this->limit);
+}
+
+void cppiper::ChunkSizer::observe(size_t frame_bytes) {
+  if (fixed > 0)
+    return;
+  const uint64_t sample(static_cast<uint64_t>(frame_bytes) << 4);
+  average = average == 0 ? sample : average - (average >> 4) + (sample >> 4);
+  if (++observed < UPDATE_INTERVAL)
+    return;
+  observed = 0;
+  const size_t target(std::clamp<size_t>(
+      ring_capacity((average >> 4) * FRAMES_PER_CHUNK), CHUNK_SIZE_MIN, limit));
+  const size_t current(chunk.load(std::memory_order_relaxed));
+  if (target > current or target <= current / 4)
+    chunk.store(target, std::memory_order_relaxed);
+}
+
+size_t cppiper::ChunkSizer::get(void) const {
+  return chunk.load(std::memory_order_relaxed);
+}
+
+size_t cppiper::tune_pipe_capacity(int fd, size_t capacity,
+                                   const std::filesystem::path &pipepath) {
+  if (capacity > 0) {
+    size_t max_capacity(0);
+    std::ifstream("/proc/sys/fs/pipe-max-size") >> max_capacity;
+    if (max_capacity > 0 and capacity > max_capacity) {
+      LOG(WARNING) << "Requested capacity " << capacity << " of pipe "
+                   << pipepath.filename() << " exceeds the system maximum "
+                   << max_capacity;
+      capacity = max_capacity;
+    }
+    if (fcntl(fd, F_SETPIPE_SZ, static_cast<int>(capacity)) == -1)
+      LOG(WARNING) << "Failed to resize pipe " << pipepath.filename()
+                   << " to " << capacity << " bytes, " << errno;
+  }
+  const int actual(fcntl(fd, F_GETPIPE_SZ));
+  if (actual == -1)
+    return 0;
+  DEBUG_LOG << "Pipe " << pipepath.filename() << " holds " << actual
+            << " bytes";
+  return actual;
+}
+
+namespace {
+
+//! Hint the CPU that the thread is spinning.
+inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+cppiper::SpinWait::SpinWait(WaitStrategy strategy,
+                            std::chrono::nanoseconds budget)
+    : strategy(strategy), budget(budget), deadline(), spinning(false) {}
+
+bool cppiper::SpinWait::spin(void) {
+  switch (strategy) {
+  case WaitStrategy::PARK:
+    return false;
+  case WaitStrategy::SPIN_THEN_PARK: {
+    const auto now(std::chrono::steady_clock::now());
+    if (not spinning) {
+      spinning = true;
+      deadline = now + budget;
+    } else if (now >= deadline)
+      return false;
+    break;
+  }
+  case WaitStrategy::BUSY_POLL:
+    break;
+  }
+  cpu_relax();
+  return true;
+}
+
+void cppiper::SpinWait::reset(void) { spinning = false; }
+
+bool cppiper::apply_thread_options(pthread_t thread,
+                                   const ThreadOptions &options,
+                                   const std::string &name) {
+  bool applied(true);
+  if (not options.cpus.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : options.cpus)
+      if (cpu >= 0 and cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &cpus);
+    const int error(pthread_setaffinity_np(thread, sizeof(cpus), &cpus));
+    if (error != 0) {
+      LOG(WARNING) << "Failed to pin the thread of " << name << " to "
+                   << options.cpus.size() << " CPUs, " << error;
+      applied = false;
+    } else
+      DEBUG_LOG << "Pinned the thread of " << name << " to "
+                << options.cpus.size() << " CPUs";
+  }
+  if (options.policy != -1) {
+    sched_param param{};
+    param.sched_priority = options.priority;
+    const int error(pthread_setschedparam(thread, options.policy, &param));
+    if (error != 0) {
+      LOG(WARNING) << "Failed to set scheduling policy " << options.policy
+                   << " on the thread of " << name << ", " << error;
+      applied = false;
+    } else
+      DEBUG_LOG << "Set scheduling policy " << options.policy
+                << " on the thread of " << name;
+  }
+  return applied;
+}